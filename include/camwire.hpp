@@ -34,6 +34,8 @@ Camwire++: Michele Adduci <info@micheleadduci.net>
 ******************************************************************************/
 
 #include <camwire_handle.hpp>
+#include <camwire_frame.hpp>
+#include <vector>
 
 namespace camwire
 {
@@ -128,6 +130,32 @@ namespace camwire
                be faster.  Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on
                failure. */
             int copy_next_frame(const Camwire_bus_handle_ptr &c_handle, void *buffer, int &buffer_lag);
+            /* Like copy_next_frame(), except that 16-bit images are copied in
+               the host's byte order instead of network byte order, in the same
+               pass over the frame.  Each 16-bit component is also shifted left
+               by shift bits if it is positive or right by -shift bits if it is
+               negative, for example -4 to right-justify 12-bit data which the
+               camera delivers left-justified.  Signed codings keep their
+               sign.  For 8-bit images shift must be 0 and the frame is copied
+               unchanged.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int copy_next_frame_native(const Camwire_bus_handle_ptr &c_handle, void *buffer, int &buffer_lag, const int shift = 0);
+            /* Like copy_next_frame(), except that the frame is converted to the
+               output layout while it is copied, in a single pass over the DMA
+               buffer which also does any host colour correction and image
+               statistics.  The buffer is given back to the camera as soon as
+               the pass is done.  Bayer images are demosaiced bilinearly using the
+               camera's tiling, YUV images are converted with BT.601 and
+               colour images are reduced to gray by their BT.601 luma.  8-bit
+               components are widened to 16 bits linearly, or through the
+               inverse gamma table if the camera's gamma is on (see
+               camwire_set_gamma()).  16-bit outputs are in network byte order.
+               dst_stride is the number of bytes between output rows, or 0 for
+               tightly packed rows.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure, including when the current pixel
+               coding cannot be converted to output. */
+            int copy_next_frame_as(const Camwire_bus_handle_ptr &c_handle, void *buffer, const Camwire_output output,
+                                   const size_t dst_stride, int &buffer_lag);
             /* Sets the given buffer pointer buf_ptr to the next received frame
                buffer.  If a frame is ready it returns immediately, otherwise it
                waits until a frame has been received.  All 16-bit camwire images are
@@ -164,6 +192,14 @@ namespace camwire
                not be called.  Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE
                on failure. */
             int point_next_frame_poll(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag);
+            /* Like point_next_frame() but waits at most timeout seconds for a
+               frame to arrive.  The calling thread sleeps on the capture file
+               descriptor while it waits, so no CPU time is used.  If no frame
+               arrives in time it sets buf_ptr to the null pointer and returns
+               0 in buffer_lag, in which case camwire_unpoint_frame() should
+               not be called.  A negative timeout waits indefinitely.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int point_next_frame_for(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag, const double timeout);
             /* Releases the bus frame buffer that was pointed to with the pointer
                access functions camwire_point_next_frame() or
                camwire_point_next_frame_poll(), so that it can be used again for
@@ -174,6 +210,111 @@ namespace camwire
                locked in which case it has no effect.  Returns CAMWIRE_SUCCESS on
                success or CAMWIRE_FAILURE on failure. */
             int unpoint_frame(const Camwire_bus_handle_ptr &c_handle);
+            /* Sets the given buffer pointer buf_ptr to the next received frame
+               buffer, waiting until a frame has been received like
+               point_next_frame().  Unlike point_next_frame(), the frame does not
+               have to be released before the next one is accessed: up to
+               get_num_framebuffers() - 1 frames can be held at the same time,
+               so that the processing of consecutive frames can overlap.  Each
+               held frame must be given back with release_frame(), in any order
+               and from any thread.  Frames should be dequeued from one thread
+               only.  Fails if the maximum number of frames is already held.
+               set_num_framebuffers(), set_frame_size(), set_pixel_coding(),
+               set_framerate(), apply_state() and destroy() set up a new DMA
+               ring, which takes back every held frame: its buffer must not
+               be used afterwards and release_frame() refuses it.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int hold_next_frame(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag);
+            /* Like hold_next_frame() but returns immediately.  If no frame is
+               ready it sets buf_ptr to the null pointer and returns 0 in
+               buffer_lag, in which case release_frame() should not be called.
+               Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on
+               failure. */
+            int hold_next_frame_poll(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag);
+            /* Like hold_next_frame() but waits at most timeout seconds, as
+               point_next_frame_for() does.  If no frame arrives in time it
+               sets buf_ptr to the null pointer.  Returns CAMWIRE_SUCCESS on
+               success or CAMWIRE_FAILURE on failure. */
+            int hold_next_frame_for(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag, const double timeout);
+            /* Releases the held frame buffer buf_ptr obtained from
+               hold_next_frame() or hold_next_frame_poll(), so that it can be
+               used again for receiving new image data.  May be called from any
+               thread.  A buffer obtained from point_next_frame() is refused
+               and must be given back with unpoint_frame().  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure or if
+               buf_ptr is not a held frame. */
+            int release_frame(const Camwire_bus_handle_ptr &c_handle, const void *buf_ptr);
+            /* Sets generation to the DMA ring that the held frame buffer
+               buf_ptr belongs to, for release_frame() below.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure or if
+               buf_ptr is not a held frame. */
+            int get_frame_generation(const Camwire_bus_handle_ptr &c_handle, const void *buf_ptr, uint64_t &generation);
+            /* Like release_frame() above, but also fails if the DMA ring
+               has been set up again since generation was read with
+               get_frame_generation(), in which case a buffer at the same
+               address belongs to a newer frame.  Returns CAMWIRE_SUCCESS on
+               success or CAMWIRE_FAILURE on failure. */
+            int release_frame(const Camwire_bus_handle_ptr &c_handle, const void *buf_ptr, const uint64_t generation);
+            /* Holds the next received frame in frame, waiting at most timeout
+               seconds (indefinitely if negative) like hold_next_frame_for().
+               The frame's geometry, pixel coding, number, time stamp and
+               buffer lag are filled in at the same time, so no further getter
+               calls are needed.  The buffer is given back to the camera when
+               frame is destroyed or released; any frame it held before is
+               released first.  The camwire object must outlive the frame.
+               Setting up a new DMA ring takes the frame back as for
+               hold_next_frame(), after which its data() must not be used
+               and release() fails.  On timeout frame is left empty and the
+               function succeeds.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int dequeue_frame(const Camwire_bus_handle_ptr &c_handle, Camwire_frame &frame, const double timeout = -1.0);
+            /* Holds every frame that is already waiting in the DMA ring, in one
+               call and without waiting, and appends them to frames oldest
+               first.  frames is cleared (releasing what it held) beforehand.
+               Stops early if the get_num_framebuffers() - 1 limit on held
+               frames is reached.  num_taken is set to the number of frames
+               taken.  Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE
+               on failure. */
+            int drain_frames(const Camwire_bus_handle_ptr &c_handle, std::vector<Camwire_frame> &frames, int &num_taken);
+            /* Gives back every frame waiting in the DMA ring except the most
+               recent one, which is held in newest.  Does not wait: if no frame
+               is waiting newest is left empty.  num_discarded is set to the
+               number of older frames given back unseen.  Only one extra frame
+               buffer is held at any time.  Returns CAMWIRE_SUCCESS on success
+               or CAMWIRE_FAILURE on failure. */
+            int drain_to_newest(const Camwire_bus_handle_ptr &c_handle, Camwire_frame &newest, int &num_discarded);
+            /* Sets or clears latest-only capture mode.  In this mode every
+               frame access function returns the most recent completed frame:
+               older frames still waiting in the DMA ring are given back to
+               the camera unseen and counted by get_frames_skipped().  This
+               keeps the latency as low as possible for applications which
+               have no use for a backlog.  The default is off.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int set_latest_only(const Camwire_bus_handle_ptr &c_handle, const int latest_only);
+            /* Gets the latest-only capture mode flag.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int get_latest_only(const Camwire_bus_handle_ptr &c_handle, int &latest_only);
+            /* Gets the number of frames skipped in latest-only mode since the
+               camera was created.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int get_frames_skipped(const Camwire_bus_handle_ptr &c_handle, int64_t &frames_skipped);
+            /* Sets the clock on which get_timestamp() and Camwire_frame time
+               stamps are given.  CAMWIRE_CLOCK_MONOTONIC and
+               CAMWIRE_CLOCK_REALTIME map each frame's DMA time stamp onto the
+               host clock, so they do not include any delay before the frame
+               is dequeued.  The offset and drift between the clocks are
+               re-estimated every few hundred frames rather than per frame.
+               The default is CAMWIRE_CLOCK_DC1394.  Returns CAMWIRE_SUCCESS
+               on success or CAMWIRE_FAILURE on failure. */
+            int set_timestamp_clock(const Camwire_bus_handle_ptr &c_handle, const Camwire_clock clock);
+            /* Gets the clock set with set_timestamp_clock().  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int get_timestamp_clock(const Camwire_bus_handle_ptr &c_handle, Camwire_clock &clock);
+            /* Gets the number of frame buffers currently held by the caller,
+               through either the pointer or the hold access functions.
+               Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on
+               failure. */
+            int get_num_held_frames(const Camwire_bus_handle_ptr &c_handle, int &num_held);
             /* Transforms cam_buf into lin_buf by inverse gamma correction assuming
                the Rec.709 specification.  This should only be used to linearize the
                response of images that were captured while gamma correction was
@@ -193,6 +334,65 @@ namespace camwire
                65535.  Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on
                failure. */
             int inv_gamma(const Camwire_bus_handle_ptr &c_handle, const void *cam_buf, void *lin_buf, const unsigned long max_val);
+            /* Converts the 16-bit image in buffer, in the current pixel coding
+               and in network byte order as from point_next_frame(), to the
+               host's byte order in place, shifting each component by shift
+               bits as for copy_next_frame_native().  Returns CAMWIRE_SUCCESS on
+               success or CAMWIRE_FAILURE on failure. */
+            int native_byte_order(const Camwire_bus_handle_ptr &c_handle, void *buffer, const int shift = 0);
+            /* Demosaics the raw Bayer image in raw_buf, in the current 8- or
+               16-bit raw or mono pixel coding, into rgb_buf using the colour
+               tiling reported by the camera (see get_pixel_tiling()).  The
+               output layout is one of CAMWIRE_OUTPUT_RGB8, CAMWIRE_OUTPUT_BGR8
+               or CAMWIRE_OUTPUT_RGB16, the latter in network byte order.
+               CAMWIRE_DEMOSAIC_NEAREST copies from the 2x2 tile,
+               CAMWIRE_DEMOSAIC_BILINEAR averages the nearest sites and
+               CAMWIRE_DEMOSAIC_EDGE_AWARE interpolates green along edges and red
+               and blue as colour differences, which avoids most zipper and
+               colour fringe artifacts at some cost.  dst_stride is the number of
+               bytes between output rows, or 0 for tightly packed rows.  The
+               image is split into num_threads bands of rows which are done in
+               parallel on worker threads kept by the handle, so that none are
+               started per frame.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int demosaic(const Camwire_bus_handle_ptr &c_handle, const void *raw_buf, void *rgb_buf,
+                         const Camwire_output output, const Camwire_demosaic method,
+                         const size_t dst_stride = 0, const int num_threads = 1);
+            /* Converts the image in yuv_buf, in the current YUV411, YUV422 or
+               YUV444 pixel coding, into out_buf in the output layout
+               CAMWIRE_OUTPUT_GRAY8, CAMWIRE_OUTPUT_RGB8 or CAMWIRE_OUTPUT_BGR8.
+               YUV422 is read as UYVY or YUYV according to the tiling reported
+               by the camera (see get_pixel_tiling()), and as UYVY if none is
+               reported.  matrix selects the BT.601 or BT.709 coefficients.
+               Gray output just extracts the luma, which is much faster than
+               converting to RGB.  dst_stride is the number of bytes between
+               output rows, or 0 for tightly packed rows.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int convert_yuv(const Camwire_bus_handle_ptr &c_handle, const void *yuv_buf, void *out_buf,
+                            const Camwire_output output, const Camwire_yuv_matrix matrix = CAMWIRE_YUV_BT601,
+                            const size_t dst_stride = 0);
+            /* Gets the width and height in pixels of the current frame reduced
+               by factor in each direction by reduce_frame().  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int get_reduced_frame_size(const Camwire_bus_handle_ptr &c_handle, const int factor,
+                                       int &width, int &height);
+            /* Reduces the image in src, in the current pixel coding as from
+               point_next_frame() or hold_next_frame(), by factor 2 or 4 in each
+               direction into dst in the same pixel coding, in one pass over the
+               source.  CAMWIRE_REDUCE_BIN averages each factor by factor block of
+               same-colour pixels, which also lowers the noise, and
+               CAMWIRE_REDUCE_DECIMATE keeps the first pixel of each block.  Bayer
+               images are reduced tile by tile so that the result is a Bayer
+               image with the same tiling, and YUV images keep their chroma
+               subsampling.  Mono, raw, RGB and YUV codings are supported.  The
+               size of the result is given by get_reduced_frame_size().
+               dst_stride is the number of bytes between output rows, or 0 for
+               tightly packed rows.  Useful for preview streams from cameras that
+               cannot bin in hardware.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int reduce_frame(const Camwire_bus_handle_ptr &c_handle, const void *src, void *dst,
+                             const int factor, const Camwire_reduction method = CAMWIRE_REDUCE_BIN,
+                             const size_t dst_stride = 0);
             /* Sets the camera run status in runsts: 1 for running or 0 for stopped.
                If a stopped camera is set to running while the acquisition type (as
                set by camwire_set_single_shot()) is single-shot, then only one frame
@@ -261,10 +461,12 @@ namespace camwire
                colour-corrected or 0 for no correction.  Colour correction only
                takes effect if the current pixel coding is colour (such as
                CAMWIRE_PIXEL_YUV422 or CAMWIRE_PIXEL_RGB8, but not
-               CAMWIRE_PIXEL_MONO8 etc.).  So far Camwire supports colour correction
-               in AVT cameras only.  Returns CAMWIRE_SUCCESS on success or
-               CAMWIRE_FAILURE on failure or if the camera is not capable of colour
-               correction. */
+               CAMWIRE_PIXEL_MONO8 etc.).  AVT cameras correct colour themselves.
+               For other cameras Camwire applies the matrix on the host to
+               CAMWIRE_PIXEL_RGB8 and CAMWIRE_PIXEL_RGB16 frames as they are
+               handed out by the frame access functions, so every camera gives
+               the same output.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
             int set_colour_correction(const Camwire_bus_handle_ptr &c_handle, const int corr_on);
             /* Sets the camera's colour correction coefficients.  coef is an array
                of 9 colour correction coefficients, see the description of the
@@ -272,9 +474,11 @@ namespace camwire
                colour correction with fixed coefficients in which case
                camwire_set_colour_correction() above can enable colour correction
                but this function would fail because it cannot change the
-               coefficients.  Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE
-               on failure or if the camera is not capable of setting colour
-               coefficients. */
+               coefficients.  Cameras without any colour correction take
+               coefficients between -8.0 and +8.0 for the host-side correction
+               (see camwire_set_colour_correction() above).  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure or if the
+               camera is not capable of setting colour coefficients. */
             int set_colour_coefficients(const Camwire_bus_handle_ptr &c_handle, const double coef[9]);
             /* Sets the camera's gamma setting in gamma_on: 1 for gamma-corrected or
                0 for linear pixel values.  Camwire assumes that gamma correction
@@ -314,6 +518,38 @@ namespace camwire
                afterwards with camwire_get_framerate().  Returns CAMWIRE_SUCCESS on
                success or CAMWIRE_FAILURE on failure. */
             int set_frame_size(const Camwire_bus_handle_ptr &c_handle, const int width, const int height);
+            /* Sets the frame offset (left, top) in units of pixels to the nearest
+               values valid for the camera, keeping the frame size.  The offsets
+               available may be constrained by the maximum available frame size
+               and the current frame size.  Only the Format 7 image position
+               register is written: the frame buffers, the frame size and the
+               other settings are kept, so a moving region of interest costs
+               about one register write.  If the camera refuses the write while
+               it is running, it is stopped for the write and started again
+               without a reconnect.  The actual offset set can be checked
+               afterwards with camwire_get_frame_offset().  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int set_frame_offset(const Camwire_bus_handle_ptr &c_handle, const int left, const int top);
+            /* Sets the video frame rate in frames per second to the nearest valid
+               value for the camera.  The frame rate is the rate at which the camera
+               transmits frames to the computer; frames may come more slowly with a
+               long shutter time or an external trigger.  In Formats 0, 1 and 2 the
+               nearest standard frame rate is chosen.  In Format 7 the frame rate
+               follows from the packet size, which is chosen to spread each frame
+               over the right number of bus cycles, so a lower frame rate also uses
+               less bus bandwidth.  If the rate register or packet size does not
+               change nothing is written.  Otherwise only that register is written
+               and the DMA buffers are set up again for the new packet layout,
+               after waiting for a running camera to stop; the image format and all
+               other settings are kept, and the camera is restarted if it was
+               running.  Because the DMA buffers are set up again, a rate change
+               fails while any frame from hold_next_frame(), dequeue_frame() or
+               point_next_frame() is still held; a change that needs no new
+               buffers does not.  If the camera refuses the new rate, capture
+               resumes at the old one.  The actual frame rate can be checked afterwards with
+               camwire_get_framerate().  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int set_framerate(const Camwire_bus_handle_ptr &c_handle, const double frame_rate);
             /* Sets the pixel coding, given one of the Camwire_pixel enumeration
                members above.  For some camera buses like IEEE 1394, the frame rate
                may also change, especially with small frame sizes.  Check afterwards
@@ -321,6 +557,26 @@ namespace camwire
                CAMWIRE_FAILURE on failure or if gamma is switched on and the new
                coding does not support gamma correction. */
             int set_pixel_coding(const Camwire_bus_handle_ptr &c_handle, const Camwire_pixel coding);
+            /* Brings the camera to the settings in desired in one transaction.
+               The settings are compared with the current shadow state and only
+               those which differ are written, in an order which needs at most
+               one disconnect and reconnect.  A reconnect is only done if the
+               number of frame buffers, the frame size or the pixel depth
+               changes; an offset or frame rate on its own is changed as by
+               set_frame_offset() or set_framerate(), and everything else is
+               written to the running camera.  A camera that is to be stopped
+               is stopped before anything else is written and one that is to
+               be started is started last, so that no frame is taken with a
+               mix of old and new settings.
+               The pixel tiling cannot be set and is ignored.  applied is set
+               to the Camwire_state_change flags of the settings that were
+               written, 0 if the camera was
+               already in the desired state.  Fails without writing anything if
+               desired asks for a frame size, offset or pixel coding change in a
+               fixed image size format.  If a later write fails, applied tells
+               which settings were written before it.  Returns CAMWIRE_SUCCESS on
+               success or CAMWIRE_FAILURE on failure. */
+            int apply_state(const Camwire_bus_handle_ptr &c_handle, const Camwire_state_ptr &desired, int &applied);
             /* Gets the camera's current settings (running/stopped, trigger source,
                frame rate, frame size, etc).  If the camera has not been created,
                the camera is physically reset to factory default settings and those
@@ -435,6 +691,59 @@ namespace camwire
                and should otherwise be considered stale.  Returns CAMWIRE_SUCCESS on
                success or CAMWIRE_FAILURE on failure. */
             int get_framebuffer_lag(const Camwire_bus_handle_ptr &c_handle, int &buffer_lag);
+            /* Gets the time stamp in seconds of the last frame accessed, on the
+               clock chosen with set_timestamp_clock().  The time stamp is
+               taken when the frame's DMA transfer completes.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int get_timestamp(const Camwire_bus_handle_ptr &c_handle, double &timestamp);
+            /* Gets the serial number of the last frame accessed.  Frames are
+               numbered from 1 in the order they arrived since the camera was
+               created, including frames flushed or skipped.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int get_framenumber(const Camwire_bus_handle_ptr &c_handle, int64_t &frame_number);
+            /* Gets the cumulative capture statistics of the camera: frames
+               delivered, frames dropped, frames skipped in latest-only mode,
+               the last and largest buffer lag and the DMA ring high-water
+               mark.  Dropped frames are estimated from gaps between
+               consecutive DMA time stamps larger than the nominal frame
+               period, and are not counted while the camera is externally
+               triggered.  The counters are read without locking, so this
+               may be called from any thread at any time.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int get_capture_stats(const Camwire_bus_handle_ptr &c_handle, Camwire_capture_stats &stats);
+            /* Sets all capture statistics counters back to zero.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int reset_capture_stats(const Camwire_bus_handle_ptr &c_handle);
+            /* Turns the measurement of image statistics on (enable non-zero) or
+               off.  While on, the mean, minimum, maximum, clipped count and
+               histogram described for Camwire_image_stats are worked out for
+               every frame as it is dequeued, while it is still in the cache,
+               and can be read with get_image_stats() or from the
+               Camwire_frame.  Only the region of interest roi_width by
+               roi_height pixels from (left, top) is measured, clipped to the
+               frame; a zero width or height extends it to the edge of the
+               frame.  A step larger than 1 samples only every step-th pixel
+               (or 2x2 tile of Bayer images) in each direction, which is
+               usually accurate enough for exposure control at a fraction of
+               the cost.  May be called from any thread.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int set_image_stats(const Camwire_bus_handle_ptr &c_handle, const int enable, const int step = 1,
+                                const int left = 0, const int top = 0, const int roi_width = 0,
+                                const int roi_height = 0);
+            /* Gets the image statistics of the last frame dequeued while they
+               were on.  stats.samples is 0 if no frame has been measured yet.
+               May be called from any thread.  Returns CAMWIRE_SUCCESS on
+               success or CAMWIRE_FAILURE on failure. */
+            int get_image_stats(const Camwire_bus_handle_ptr &c_handle, Camwire_image_stats &stats);
+            /* Like get_image_stats() but first waits up to timeout seconds
+               (indefinitely if negative) for the statistics of a frame later
+               than after_frame, as given by stats.frame_number.  On timeout
+               stats holds the latest statistics there are and the function
+               succeeds.  Meant for a thread, such as an exposure controller,
+               which follows the capture without slowing it down.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int wait_image_stats(const Camwire_bus_handle_ptr &c_handle, Camwire_image_stats &stats,
+                                 const int64_t after_frame, const double timeout);
             /* Gets the state shadow flag: 1 to get camera settings from an internal
                shadow structure or 0 to read them directly from the camera hardware.
                Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure.*/
@@ -481,7 +790,22 @@ namespace camwire
 
             bool getenv(const char *name, std::string &env);
 
+            /*
+              Sleeps for multiple frame periods at the current frame rate.
+            */
             int sleep_frametime(const Camwire_bus_handle_ptr &c_handle, const double multiple);
+            /*
+              Waits for a camera that has just been told to stop to actually
+              stop: first for its transmission register to read off, then for
+              the capture file descriptor to stay quiet for one frame time,
+              which lets the frame in flight land.  The frame time is the
+              frame period plus the shutter time.  Frames that arrive in the
+              meantime are given straight back, since the capture is about to
+              be torn down.  Gives up after STOP_TIMEOUT_FRAMES frame times.
+              Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure
+              or if transmission does not stop in time.
+            */
+            int wait_for_stop(const Camwire_bus_handle_ptr &c_handle);
             /*
               Connects the camera to the bus and sets it to the given configuration
               and initial settings.  Returns CAMWIRE_SUCCESS on success or
@@ -499,6 +823,48 @@ namespace camwire
               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure.
             */
             int reconnect_cam(const Camwire_bus_handle_ptr &c_handle, Camwire_conf_ptr &cfg, const Camwire_state_ptr &set);
+            /*
+              Sets the Format 7 colour coding, image position and size, and the
+              packet size for the frame rate in set, and sets up the DMA
+              buffers.  Part of connect_cam().
+            */
+            int setup_format7_capture(const Camwire_bus_handle_ptr &c_handle, const dc1394video_mode_t video_mode,
+                                      const Camwire_state_ptr &set, Camwire_pixel &actual_coding,
+                                      double &actual_frame_rate);
+            /*
+              Records in the internal status that the DMA buffers have just
+              been set up for the given frame format.
+            */
+            int capture_connected(const Camwire_bus_handle_ptr &c_handle, const int num_frame_buffers,
+                                  const int width, const int height, const Camwire_pixel coding,
+                                  const double frame_rate);
+            /*
+              Stops the camera if it is running, waits for it to stop and
+              tears down the DMA buffers, keeping all camera settings.
+              Fails without touching the camera while any frame is held.
+              was_running is set for resume_capture().
+            */
+            int pause_capture(const Camwire_bus_handle_ptr &c_handle, int &was_running);
+            /*
+              Sets up the DMA buffers again after pause_capture() for the
+              current frame geometry, records frame_rate and restarts the
+              camera if was_running.
+            */
+            int resume_capture(const Camwire_bus_handle_ptr &c_handle, const int was_running, const double frame_rate);
+            /*
+              Returns the Camwire_state_change flags of the settings which
+              differ between from and to.  The tiling is not compared.
+            */
+            int state_changes(const Camwire_state &from, const Camwire_state &to);
+            /*
+              Rounds width and height to the nearest Format 7 size valid for
+              the camera with its frame at offset (left, top), keeping within
+              the maximum size and above the configured minimum number of
+              pixels.  Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE
+              on failure.
+            */
+            int fit_frame_size(const Camwire_bus_handle_ptr &c_handle, const int left, const int top,
+                               int &width, int &height);
 
             /* Disconnects the camera from the bus and frees memory allocated in
               connect_cam().  The camera should be stopped before calling this
@@ -720,6 +1086,85 @@ namespace camwire
               functions.
             */
             int get_captureframe(const Camwire_bus_handle_ptr &c_handle, std::shared_ptr<dc1394video_frame_t> &frame);
+            /*
+              Dequeues the next frame from the DMA ring with the given libdc1394
+              policy and records it as held.  frame is set to the null pointer
+              if the policy is DC1394_CAPTURE_POLICY_POLL and no frame is ready.
+              Fails without dequeueing if num_dma_buffers - 1 frames are
+              already held.  Returns CAMWIRE_SUCCESS on success or
+              CAMWIRE_FAILURE on failure.
+            */
+            int capture_dequeue(const Camwire_bus_handle_ptr &c_handle, const dc1394capture_policy_t policy, dc1394video_frame_t *&frame);
+            /*
+              Gives a held frame back to the DMA ring.  Returns CAMWIRE_SUCCESS
+              on success or CAMWIRE_FAILURE on failure or if frame is not held.
+            */
+            int capture_enqueue(const Camwire_bus_handle_ptr &c_handle, dc1394video_frame_t *frame);
+            /*
+              Corrects the colour of and measures a frame about to be handed
+              to the caller, and counts it as delivered.
+            */
+            void deliver_frame(const User_handle &internal_status, dc1394video_frame_t *frame);
+            /*
+              Updates the lag and dropped-frame statistics for a frame just
+              dequeued from the DMA ring.
+            */
+            void record_frame_stats(const User_handle &internal_status, const dc1394video_frame_t *frame);
+            /*
+              Samples the libdc1394 time stamp clock and the chosen host clock
+              together, and updates the offset and drift between them.
+            */
+            int sync_timestamp_clock(const Camwire_bus_handle_ptr &c_handle);
+            /*
+              Maps a libdc1394 time stamp in seconds onto the chosen clock.
+            */
+            double convert_dma_timestamp(const User_handle &internal_status, const double dma_time);
+            /*
+              Gives all held frames back to the DMA ring, ignoring errors.  Used
+              before the capture is stopped.
+            */
+            void capture_enqueue_all(const Camwire_bus_handle_ptr &c_handle);
+            /*
+              Fills frame from the held DMA frame dma_frame, which it will
+              release when it is destroyed.
+            */
+            void fill_frame(const Camwire_bus_handle_ptr &c_handle, dc1394video_frame_t *dma_frame, Camwire_frame &frame);
+            /*
+              Applies the colour correction matrix to rows row_begin to
+              row_end - 1 of the RGB8 or RGB16 frame in place, if colour
+              correction is on and the camera cannot do it itself.  Called
+              only for frames handed to the caller.
+            */
+            void correct_frame_colour(const User_handle &internal_status, dc1394video_frame_t *frame,
+                                      const int row_begin, const int row_end);
+            /*
+              Reads the image statistics sampling step and region, the latter
+              clipped to the current frame size as left, top, width and
+              height.  Returns 0 if image statistics are off.
+            */
+            int stats_settings(const User_handle &internal_status, int &step, int region[4]);
+            /*
+              Publishes a copy of stats as those of the current frame in
+              internal_status->image_stats and wakes wait_image_stats().
+            */
+            void publish_stats(const User_handle &internal_status, Camwire_image_stats &stats);
+            /*
+              Works out the image statistics of the frame if they are on, and
+              stores them in internal_status->image_stats.  Called only for
+              frames handed to the caller, after correct_frame_colour().
+            */
+            void measure_frame(const User_handle &internal_status, const dc1394video_frame_t *frame);
+            /*
+              Works out internal_status->geometry from the given frame size
+              and pixel coding.  Called whenever these change.
+            */
+            int update_geometry(const Camwire_bus_handle_ptr &c_handle, const int width, const int height, const Camwire_pixel coding);
+            /*
+              Sleeps on the capture file descriptor for up to timeout seconds
+              (indefinitely if negative) and dequeues the next frame as soon as
+              one is ready.  frame is set to 0 on timeout.
+            */
+            int capture_dequeue_for(const Camwire_bus_handle_ptr &c_handle, const double timeout, dc1394video_frame_t *&frame);
             /*
               Returns the number of bits per component in the given pixel coding.
             */
@@ -0,0 +1,110 @@
+#ifndef CAMWIRE_FRAME_HPP
+#define CAMWIRE_FRAME_HPP
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+    Title: Header for camwire_frame.cpp
+
+    Description:
+    A Camwire_frame is a view of one DMA frame buffer held by
+    camwire::dequeue_frame(), together with the metadata that describes
+    it.  Everything is captured once when the frame is dequeued, so no
+    getter calls are needed per frame.  The frame gives its buffer back
+    to the camera when it is destroyed, so it can be moved but not
+    copied.  Reconfiguring the camera in a way that sets up a new DMA
+    ring (see camwire::hold_next_frame()) invalidates every outstanding
+    frame: its data must no longer be used, and releasing it fails
+    instead of giving back a buffer of the new ring.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+
+#include <camwire_handle.hpp>
+#include <cstddef>
+#include <memory>
+
+namespace camwire
+{
+    class camwire;
+
+    class Camwire_frame
+    {
+        public:
+            /* An empty frame, which holds no buffer. */
+            Camwire_frame();
+            /* Gives the buffer back to the camera, if one is held. */
+            ~Camwire_frame();
+            /* Moving never fails, so frames can be kept in a std::vector: */
+            Camwire_frame(Camwire_frame &&other) noexcept;
+            Camwire_frame& operator=(Camwire_frame &&other) noexcept;
+            /* Gives the buffer back to the camera now and leaves the frame
+               empty.  Safe to call on an empty frame.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure or if
+               the DMA ring was set up again since the frame was dequeued. */
+            int release();
+            /* Returns true if no buffer is held. */
+            bool empty() const {return buffer == 0;}
+
+            /* The image data.  All 16-bit images are in network (big-endian)
+               byte order.  The buffer may be read and written until the frame
+               is released. */
+            unsigned char * data() const {return buffer;}
+            /* Number of image bytes at data(). */
+            size_t size() const {return bytes;}
+            int width() const {return frame_width;}
+            int height() const {return frame_height;}
+            Camwire_pixel coding() const {return pixel_coding;}
+            /* Bytes from the start of one row to the start of the next. */
+            size_t stride() const {return row_stride;}
+            /* Frame number as from get_framenumber(). */
+            int64_t frame_number() const {return number;}
+            /* DMA time stamp in seconds, on the clock chosen with
+               set_timestamp_clock(). */
+            double timestamp() const {return dma_timestamp;}
+            /* Frames that were waiting in the DMA ring behind this one when
+               it was dequeued. */
+            int frames_behind() const {return lag;}
+            /* Image statistics of this frame, if they were on when it was
+               dequeued (see camwire::set_image_stats()), else null.  They
+               are shared rather than copied, so they may be kept after the
+               frame is released. */
+            const std::shared_ptr<const Camwire_image_stats> & image_stats() const {return stats;}
+
+        private:
+            friend class camwire;
+            camwire *owner;   /* Must outlive the frame.*/
+            Camwire_bus_handle_ptr handle;
+            unsigned char *buffer;
+            size_t bytes;
+            int frame_width;
+            int frame_height;
+            Camwire_pixel pixel_coding;
+            size_t row_stride;
+            int64_t number;
+            double dma_timestamp;
+            int lag;
+            uint64_t generation;  /* DMA ring the buffer belongs to.*/
+            std::shared_ptr<const Camwire_image_stats> stats;
+            Camwire_frame(const Camwire_frame &cf);
+            Camwire_frame& operator=(const Camwire_frame &cf);
+    };
+
+}
+
+#endif
@@ -37,8 +37,12 @@ Included all the structure definition contain in camwire.c directly in one
 header file, to extract data representation from logic.
 ******************************************************************************/
 
+#include <atomic>
 #include <cinttypes>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <camwire_macros.hpp>
 #include <dc1394/camera.h>  /* dc1394camera_t.*/
 //#include <ctime>          /* For struct timespec.*/
@@ -46,6 +50,8 @@ header file, to extract data representation from logic.
 
 namespace camwire
 {
+    class camwirethreadpool;
+
     /*  Type for a unique camera identifier comprising null-terminated vendor
         name, model name, and chip number strings, such as used by
         camwire_get_identifier() below. */
@@ -90,6 +96,66 @@ namespace camwire
         CAMWIRE_TILING_YUYV
     };
 
+    /* Type for selecting the layout of images converted by the library,
+       as used by camwire_demosaic() and camwire_convert_yuv() below.  16-bit outputs are in network
+       (big-endian) byte order like all other 16-bit camwire images.
+    */
+    enum Camwire_output
+    {
+        CAMWIRE_OUTPUT_INVALID,
+        CAMWIRE_OUTPUT_GRAY8,
+        CAMWIRE_OUTPUT_GRAY16,
+        CAMWIRE_OUTPUT_RGB8,
+        CAMWIRE_OUTPUT_BGR8,
+        CAMWIRE_OUTPUT_RGB16
+    };
+
+    /* Type for selecting the Bayer interpolation method, as used by
+       camwire_demosaic() below.  NEAREST copies each missing colour from
+       the same 2x2 tile, BILINEAR averages the nearest neighbours, and
+       EDGE_AWARE interpolates green along the weaker gradient and red and
+       blue as colour differences, which avoids most zipper artefacts.
+    */
+    enum Camwire_demosaic
+    {
+        CAMWIRE_DEMOSAIC_NEAREST,
+        CAMWIRE_DEMOSAIC_BILINEAR,
+        CAMWIRE_DEMOSAIC_EDGE_AWARE
+    };
+
+    /* Type for selecting the YUV to RGB matrix, as used by
+       camwire_convert_yuv() below.  Both use the full 0-255 range, as
+       IIDC cameras do.
+    */
+    enum Camwire_yuv_matrix
+    {
+        CAMWIRE_YUV_BT601,
+        CAMWIRE_YUV_BT709
+    };
+
+    /* Type for selecting how frames are reduced in size on the host, as
+       used by camwire_reduce_frame() below.  BIN averages each block of
+       pixels of the same colour and DECIMATE keeps one pixel of each
+       block, which is faster but aliases.
+    */
+    enum Camwire_reduction
+    {
+        CAMWIRE_REDUCE_BIN,
+        CAMWIRE_REDUCE_DECIMATE
+    };
+
+    /* Type for selecting the clock on which frame time stamps are given,
+       as used by camwire_set_timestamp_clock() below.  CAMWIRE_CLOCK_DC1394
+       is libdc1394's own DMA time stamp.  The others map it onto the
+       host's CLOCK_MONOTONIC or CLOCK_REALTIME.
+    */
+    enum Camwire_clock
+    {
+        CAMWIRE_CLOCK_DC1394,
+        CAMWIRE_CLOCK_MONOTONIC,
+        CAMWIRE_CLOCK_REALTIME
+    };
+
     /* To translate to or from dc1394 mode enums: */
     static const int mode_dc1394_offset[] = {
         DC1394_VIDEO_MODE_160x120_YUV444,   /* Format 0.*/
@@ -215,6 +281,32 @@ namespace camwire
 
     typedef std::shared_ptr<Camwire_state>  Camwire_state_ptr;
 
+    /* Flags for the members of Camwire_state, as reported by
+       camwire::apply_state().  CAMWIRE_CHANGED_RECONNECT means that the
+       camera had to be disconnected and reconnected, which re-allocates
+       the frame buffers: */
+    enum Camwire_state_change
+    {
+        CAMWIRE_CHANGED_NUM_BUFFERS      = 1 << 0,
+        CAMWIRE_CHANGED_GAIN             = 1 << 1,
+        CAMWIRE_CHANGED_BRIGHTNESS       = 1 << 2,
+        CAMWIRE_CHANGED_WHITE_BALANCE    = 1 << 3,
+        CAMWIRE_CHANGED_GAMMA            = 1 << 4,
+        CAMWIRE_CHANGED_COLOUR_CORR      = 1 << 5,
+        CAMWIRE_CHANGED_COLOUR_COEF      = 1 << 6,
+        CAMWIRE_CHANGED_FRAME_OFFSET     = 1 << 7,
+        CAMWIRE_CHANGED_FRAME_SIZE       = 1 << 8,
+        CAMWIRE_CHANGED_PIXEL_CODING     = 1 << 9,
+        CAMWIRE_CHANGED_FRAME_RATE       = 1 << 10,
+        CAMWIRE_CHANGED_SHUTTER          = 1 << 11,
+        CAMWIRE_CHANGED_TRIGGER_SOURCE   = 1 << 12,
+        CAMWIRE_CHANGED_TRIGGER_POLARITY = 1 << 13,
+        CAMWIRE_CHANGED_SINGLE_SHOT      = 1 << 14,
+        CAMWIRE_CHANGED_RUNNING          = 1 << 15,
+        CAMWIRE_CHANGED_SHADOW           = 1 << 16,
+        CAMWIRE_CHANGED_RECONNECT        = 1 << 17
+    };
+
     /* Type for holding IEEE 1394 and IIDC DCAM hardware configuration data
        that the casual user probably does not want to know about.  See
        CONFIGURATION documentation for a detailed description of each
@@ -260,6 +352,72 @@ namespace camwire
 
     typedef std::shared_ptr<Extra_features> Extra_features_ptr;
 
+    /* Geometry of the frames being captured.  It is worked out whenever
+       the camera is connected, so that per-frame functions such as
+       copy_next_frame() need no getter calls: */
+    struct Camwire_geometry
+    {
+        int width;
+        int height;
+        Camwire_pixel coding;
+        Camwire_tiling tiling;
+        int depth;            /* Bits per pixel.*/
+        int component_depth;  /* Bits per colour component.*/
+        size_t stride;        /* Bytes from one row to the next.*/
+        size_t frame_bytes;   /* Image bytes, excluding any DMA padding.*/
+        Camwire_geometry(): width(0), height(0), coding(CAMWIRE_PIXEL_INVALID),
+            tiling(CAMWIRE_TILING_INVALID), depth(0),
+            component_depth(0), stride(0), frame_bytes(0) {}
+    };
+
+    /* Cumulative capture statistics of one camera, as returned by
+       camwire::get_capture_stats(): */
+    struct Camwire_capture_stats
+    {
+        int64_t frames_delivered;  /* Frames handed to the caller.*/
+        int64_t frames_dropped;    /* Estimated from gaps between DMA time stamps.*/
+        int64_t frames_skipped;    /* Recycled unseen in latest-only mode.*/
+        int last_lag;              /* frames_behind of the last dequeued frame.*/
+        int max_lag;               /* Largest frames_behind seen.*/
+        int ring_high_water;       /* Most DMA buffers ever full or held at once.*/
+        Camwire_capture_stats(): frames_delivered(0), frames_dropped(0), frames_skipped(0),
+            last_lag(0), max_lag(0), ring_high_water(0) {}
+    };
+
+    /* Brightness statistics of one frame, as returned by
+       camwire::get_image_stats().  Samples are the pixels of mono and raw
+       images, the components of RGB images and the luma of YUV images,
+       taken from the region and grid set with camwire::set_image_stats().
+       16-bit samples are binned in the histogram by their top 8 bits.
+       Samples in the top bin count as clipped: */
+    struct Camwire_image_stats
+    {
+        int64_t frame_number;  /* As from get_framenumber(), 0 if none.*/
+        int64_t samples;       /* Number of samples measured.*/
+        double mean;
+        int min, max;
+        int full_scale;        /* Largest possible sample, 255 or 65535.*/
+        int64_t clipped;
+        uint32_t histogram[256];
+        Camwire_image_stats(): frame_number(0), samples(0), mean(0), min(0), max(0), full_scale(0),
+            clipped(0), histogram() {}
+    };
+
+    /* Correlation between the libdc1394 time stamp clock and the chosen
+       host clock.  A host time t is estimated from a DMA time stamp d as
+       t = d + offset + drift*(d - reference), where offset is measured at
+       reference.  It is resampled every few hundred frames: */
+    struct Camwire_clock_sync
+    {
+        Camwire_clock clock;
+        double reference;  /* libdc1394 time of the last sample, in seconds.*/
+        double offset;     /* Host clock minus libdc1394 clock at reference.*/
+        double drift;      /* Rate of change of offset, smoothed.*/
+        int64_t next_sync_frame;
+        Camwire_clock_sync(): clock(CAMWIRE_CLOCK_DC1394), reference(0), offset(0), drift(0),
+            next_sync_frame(0) {}
+    };
+
     /* Internal camera state parameters.  If the current_set->shadow flag is
        set then, wherever possible, settings are read from the current_set
        member, else they are read directly from the camera hardware.  Each
@@ -269,17 +427,67 @@ namespace camwire
     struct Camwire_user_data
     {
         int camera_connected;  /* Flag.*/
-        int frame_lock;        /* Flag.*/
-        int64_t frame_number;  /* About 300,000 years @ 1 million fps
-                        before 63-bit overflow.*/
+        int frame_lock;        /* Flag, set while point_next_frame() holds frame.*/
+        /* Written only by the dequeueing thread, read from any thread
+           by get_framenumber().  About 300,000 years @ 1 million fps
+           before 63-bit overflow: */
+        std::atomic<int64_t> frame_number;
         int num_dma_buffers;   /* What capturing was set up with.*/
         double dma_timestamp;  /* Persistent record of last DMA buffer timestamp.*/
         Extra_features_ptr extras;
         dc1394featureset_t feature_set;
-        dc1394video_frame_t* frame;
+        Camwire_geometry geometry;
+        dc1394video_frame_t* frame;  /* Frame pointed to by point_next_frame().*/
+        /* Every frame dequeued from the DMA ring and not yet given back,
+           including the one in frame above.  At most num_dma_buffers - 1
+           of them can be held at once: */
+        std::vector<dc1394video_frame_t *> held_frames;
+        std::mutex frame_mutex;  /* Guards held_frames, capture_generation and enqueueing.*/
+        /* Counts the DMA rings set up, so that a frame held from an
+           earlier ring is not taken for one of the current ring at the
+           same address: */
+        uint64_t capture_generation;
+        int latest_only;       /* Flag, dequeue skips to the newest frame.*/
+        /* Capture statistics, written only by the dequeueing thread and
+           readable from any thread without locking: */
+        std::atomic<int64_t> frames_skipped;  /* Recycled unseen in latest_only mode.*/
+        std::atomic<int64_t> frames_delivered;
+        std::atomic<int64_t> frames_dropped;
+        std::atomic<int> last_lag;
+        std::atomic<int> max_lag;
+        std::atomic<int> ring_high_water;
+        double frame_period;     /* Nominal, from the frame rate at connection.*/
+        /* Of the previous dequeued frame, 0 if none or if the camera was
+           started or stopped since: */
+        std::atomic<double> stats_timestamp;
+        Camwire_clock_sync clock_sync;
+        /* Colour correction matrix in Q10, applied to frames on the host
+           when the camera has no colour correction of its own: */
+        int32_t host_colour_coef[9];
+        /* 8- to 16-bit table of copy_next_frame_as(), in network byte
+           order, and the gamma flag it was made for, -1 if not made: */
+        uint16_t widen_lut[256];
+        int widen_lut_gamma;
+        /* Image statistics settings, and the statistics of the last frame
+           dequeued while they were on, all guarded by stats_mutex.  The
+           statistics are never changed once published, so that frames can
+           share them; null until a frame is measured: */
+        std::mutex stats_mutex;
+        std::condition_variable stats_ready;  /* Notified when image_stats changes.*/
+        int stats_enabled;     /* Flag.*/
+        int stats_step;        /* Sample every stats_step-th pixel.*/
+        int stats_roi[4];      /* Left, top, width, height; 0 size for all.*/
+        std::shared_ptr<const Camwire_image_stats> image_stats;
+        /* Worker threads for demosaic(), made on first use and remade
+           when a different number is asked for, guarded by pool_mutex: */
+        std::shared_ptr<camwirethreadpool> pool;
+        std::mutex pool_mutex;
         Camwire_conf_ptr config_cache;
         Camwire_state_ptr current_set;
-        Camwire_user_data(): camera_connected(0), frame_lock(0), frame_number(0), num_dma_buffers(0) {}
+        Camwire_user_data(): camera_connected(0), frame_lock(0), frame_number(0), num_dma_buffers(0),
+            dma_timestamp(0), frame(0), capture_generation(0), latest_only(0), frames_skipped(0),
+            frames_delivered(0), frames_dropped(0), last_lag(0), max_lag(0), ring_high_water(0), frame_period(0),
+            stats_timestamp(0), widen_lut_gamma(-1), stats_enabled(0), stats_step(1), stats_roi() {}
     };
 
     typedef std::shared_ptr<dc1394camera_t>       Camera_handle;
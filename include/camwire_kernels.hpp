@@ -0,0 +1,193 @@
+#ifndef CAMWIRE_KERNELS_HPP
+#define CAMWIRE_KERNELS_HPP
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+    Title: Header for camwire_kernels.cpp
+
+    Description:
+    Pixel processing kernels used internally by the Camwire module.
+    Where it pays, a kernel has several implementations for different
+    instruction sets, and the fastest one the CPU supports is chosen
+    the first time the kernel is used.  All implementations of a kernel
+    give bit-identical results.  This header is not installed.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+
+#include <camwire_handle.hpp>
+#include <cstddef>
+#include <cstdint>
+
+namespace camwire
+{
+    namespace kernels
+    {
+        /* Maps num_components 8-bit values in inp to 16-bit values in
+           outp through the 256-entry look-up table lut. */
+        void lookup_8to16(const uint8_t *inp, uint16_t *outp, const size_t num_components, const uint16_t lut[256]);
+
+        /* Returns the name of the instruction set used by
+           lookup_8to16(), for diagnostics. */
+        const char * lookup_8to16_isa();
+
+        /* Returns the number of bytes per pixel of the given output
+           layout, or 0 if it is invalid. */
+        int output_bytes(const Camwire_output output);
+
+        /* Demosaics rows row_begin to row_end - 1 of the Bayer image src,
+           which is width by height pixels of src_bytes (1 or 2, the latter
+           big-endian) each with the colour layout tiling, into dst in the
+           output layout RGB8, BGR8 or RGB16.  Rows outside the range are
+           read as needed but not written, so disjoint row ranges can be
+           done in parallel.  Returns 0 if the arguments are not
+           supported. */
+        int demosaic_rows(const uint8_t *src, const size_t src_stride, const int width, const int height,
+                          const int src_bytes, const Camwire_tiling tiling,
+                          uint8_t *dst, const size_t dst_stride, const Camwire_output output,
+                          const Camwire_demosaic method, const int row_begin, const int row_end);
+
+        /* Returns the name of the instruction set used by
+           demosaic_rows(), for diagnostics. */
+        const char * demosaic_isa();
+
+        /* Converts rows row_begin to row_end - 1 of the YUV image src, in
+           the pixel coding YUV411, YUV422 or YUV444, into dst in the output
+           layout GRAY8, RGB8 or BGR8.  YUV422 is taken as UYVY unless
+           tiling is YUYV.  GRAY8 copies the luma without any arithmetic.
+           Returns 0 if the arguments are not supported. */
+        int yuv_to_rgb_rows(const uint8_t *src, const size_t src_stride, const int width,
+                            const Camwire_pixel coding, const Camwire_tiling tiling,
+                            uint8_t *dst, const size_t dst_stride, const Camwire_output output,
+                            const Camwire_yuv_matrix matrix, const int row_begin, const int row_end);
+
+        /* Returns the name of the instruction set used by
+           yuv_to_rgb_rows(), for diagnostics. */
+        const char * yuv_to_rgb_isa();
+
+        /* Converts num_components 16-bit samples in network byte order at
+           src to host byte order at dst, which may be the same buffer.
+           Each sample is then shifted left by shift bits if it is positive
+           or right by -shift bits if it is negative, with the sign kept if
+           is_signed. */
+        void be16_to_native(const uint8_t *src, uint16_t *dst, const size_t num_components,
+                            const int shift, const bool is_signed);
+
+        /* Returns the name of the instruction set used by
+           be16_to_native(), for diagnostics. */
+        const char * be16_to_native_isa();
+
+        /* Converts rows row_begin to row_end - 1 of the image src, width
+           by height pixels in pixel coding coding with colour layout
+           tiling, into dst in the output layout output, in a single pass
+           over the source rows.  Bayer codings are demosaiced with method,
+           YUV goes through yuv_to_rgb_rows() with BT.601 and colour to
+           gray takes the BT.601 luma.  8-bit components are widened to 16
+           bits through lut, whose entries are in network byte order.
+           dst holds output row dst_first_row, which must not be after
+           row_begin, so a strip can go into a buffer of its own by
+           passing row_begin.  Returns 0 if the conversion is not
+           supported. */
+        int convert_rows(const uint8_t *src, const size_t src_stride, const int width, const int height,
+                         const Camwire_pixel coding, const Camwire_tiling tiling,
+                         uint8_t *dst, const size_t dst_stride, const int dst_first_row,
+                         const Camwire_output output,
+                         const Camwire_demosaic method, const uint16_t lut[256],
+                         const int row_begin, const int row_end);
+
+        /* Multiplies every pixel of rows row_begin to row_end - 1 of the
+           colour image buf in place by the 3x3 matrix coef, laid out like
+           Camwire_state::colour_coef in Q10 fixed point.  component_bytes
+           is 1, or 2 for network byte order.  If bgr the pixels are stored
+           blue first.  Results are clamped to the component range. */
+        void colour_correct_rows(uint8_t *buf, const size_t stride, const int width, const int component_bytes,
+                                 const bool bgr, const int32_t coef[9], const int row_begin, const int row_end);
+
+        /* Returns the name of the instruction set used by
+           colour_correct_rows(), for diagnostics. */
+        const char * colour_correct_isa();
+
+        /* Sets out_width and out_height to the size of a width by height
+           image in pixel coding coding with colour layout tiling, reduced
+           by factor 2 or 4 in each direction.  The size is rounded down to
+           whole Bayer tiles or YUV groups.  Returns 0 if the coding or
+           factor is not supported. */
+        int reduced_size(const int width, const int height, const Camwire_pixel coding,
+                         const Camwire_tiling tiling, const int factor, int &out_width, int &out_height);
+
+        /* Writes output rows row_begin to row_end - 1 of the image src,
+           reduced as for reduced_size(), to dst in the same pixel coding.
+           Bayer images stay Bayer images with the same tiling.  Returns 0
+           if the arguments are not supported. */
+        int reduce_rows(const uint8_t *src, const size_t src_stride, const int width, const int height,
+                        const Camwire_pixel coding, const Camwire_tiling tiling, const int factor,
+                        const Camwire_reduction method, uint8_t *dst, const size_t dst_stride,
+                        const int row_begin, const int row_end);
+
+        /* Returns the name of the instruction set used by reduce_rows()
+           to bin mono and Bayer images, for diagnostics. */
+        const char * reduce_isa();
+
+        /* Measures the samples of the region of interest of the image src,
+           width pixels wide in pixel coding coding with colour layout
+           tiling, into stats, as described for Camwire_image_stats.  The
+           region is roi_width by roi_height pixels from (left, top) and
+           only every step-th pixel of it is sampled in each direction,
+           every step-th 2x2 tile for Bayer images.  stats.frame_number is
+           not touched.  Returns 0 if the coding is not supported or the
+           region is empty. */
+        int image_stats(const uint8_t *src, const size_t src_stride, const int width,
+                        const Camwire_pixel coding, const Camwire_tiling tiling,
+                        const int left, const int top, const int roi_width, const int roi_height,
+                        const int step, Camwire_image_stats &stats);
+
+        /* Running sums of image statistics, for measuring an image a band
+           of rows at a time: */
+        struct Stats_sums
+        {
+            uint64_t sum;          /* Of 16-bit samples only.*/
+            int64_t samples;
+            int min, max;          /* Of 16-bit samples only.*/
+            int full_scale;
+            uint32_t histogram[256];
+            Stats_sums(): sum(0), samples(0), min(65535), max(0), full_scale(0), histogram() {}
+        };
+
+        /* Like image_stats(), but measures only those rows of the region
+           which are from row_begin to row_end - 1 of the image, and adds
+           them to sums.  Rows are still sampled every step-th from the top
+           of the region, so measuring it in disjoint row ranges gives the
+           same sums as measuring it whole.  Returns 0 if the coding is not
+           supported or the region is empty. */
+        int image_stats_rows(const uint8_t *src, const size_t src_stride, const int width,
+                             const Camwire_pixel coding, const Camwire_tiling tiling,
+                             const int left, const int top, const int roi_width, const int roi_height,
+                             const int step, const int row_begin, const int row_end, Stats_sums &sums);
+
+        /* Works out stats, apart from stats.frame_number, from sums.
+           Returns 0 if no samples were measured. */
+        int finish_image_stats(const Stats_sums &sums, Camwire_image_stats &stats);
+
+        /* Returns the name of the instruction set used by image_stats()
+           for 16-bit images, for diagnostics. */
+        const char * image_stats_isa();
+    }
+}
+
+#endif
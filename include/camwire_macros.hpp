@@ -67,6 +67,21 @@ const int CAMWIRE_FAILURE = 0;  /* false */
 #define CONFFILE_EXTENSION		".conf"
 #define ENVIRONMENT_VAR_CONF    "CAMWIRE_CONF"
 
+/* Frames between re-estimates of the offset and drift between the
+   libdc1394 and host clocks, see camwire_set_timestamp_clock(): */
+#define CLOCK_SYNC_FRAMES       300
+
+/* Longest wait for a stopped camera to finish its last frame, in frame
+   times (frame period plus shutter time) but never less than
+   STOP_TIMEOUT_MIN seconds, see camwire::wait_for_stop(): */
+#define STOP_TIMEOUT_FRAMES     3.0
+#define STOP_TIMEOUT_MIN        0.1
+
+/* copy_next_frame_as() works through a frame in strips of about this many
+   bytes, small enough to stay in the cache from colour correction and
+   statistics through to conversion: */
+#define COPY_STRIP_BYTES        65536
+
 /*
     Since libdc1394 doesn't offer and "Invalid video mode" enum type, here I add it:
 */
@@ -0,0 +1,81 @@
+#ifndef CAMWIRE_THREADPOOL_HPP
+#define CAMWIRE_THREADPOOL_HPP
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+    Title: Header for camwire_threadpool.cpp
+
+    Description:
+    A fixed set of worker threads used internally to split per-frame
+    pixel work.  The threads are started once and sleep between jobs,
+    so no thread is created per frame.  This header is not installed.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace camwire
+{
+    class camwirethreadpool
+    {
+        public:
+            /* Task signature: the task index and the index of the thread
+               running it, from 0 to size() - 1, for per-thread scratch
+               memory. */
+            typedef std::function<void(const int, const int)> Task;
+
+            /* Starts num_threads - 1 workers.  The thread calling
+               parallel_for() is the last one. */
+            explicit camwirethreadpool(const int num_threads);
+            /* Stops and joins the workers. */
+            ~camwirethreadpool();
+            /* Number of threads which run tasks, the caller included. */
+            int size() const {return static_cast<int>(workers.size()) + 1;}
+            /* Runs task for every index from 0 to num_tasks - 1 and returns
+               when all are done.  Only one thread may call it at a time. */
+            void parallel_for(const int num_tasks, const Task &task);
+
+        private:
+            void worker_loop(const int thread_index);
+            void run_tasks(const int thread_index);
+
+            std::vector<std::thread> workers;
+            std::mutex job_mutex;
+            std::condition_variable job_ready;
+            std::condition_variable job_done;
+            const Task *job;
+            int job_size;
+            std::atomic<int> next_task;
+            int busy_workers;
+            uint64_t generation;   /* Counts jobs, so workers see each one once.*/
+            bool stopping;
+            camwirethreadpool(const camwirethreadpool &tp);
+            camwirethreadpool& operator=(const camwirethreadpool &tp);
+    };
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef CAMWIREACQUISITION_HPP
+#define CAMWIREACQUISITION_HPP
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+
+    Title: Header for camwireacquisition.cpp
+
+    Description:
+    This Acquisition module is an optional frame engine for a single
+    camera.  It owns a thread which does nothing but dequeue frames
+    from the camera's DMA ring as soon as they arrive and publish them
+    in a bounded queue, from which the application pops them at its own
+    pace.  A slow consumer therefore no longer delays the dequeueing.
+    Frames that the queue has no room for are given back to the camera
+    at once and counted as dropped (see get_num_dropped()); frames the
+    camera lost before they were dequeued are counted separately by
+    camwire::get_capture_stats().
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+
+#include <camwire.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace camwire
+{
+    class camwireacquisition
+    {
+        public:
+            camwireacquisition();
+            /* Stops the acquisition thread if it is still running. */
+            ~camwireacquisition();
+            /* Starts the acquisition thread for the camera c_handle, which
+               must have been created with camera_manager->create() and
+               should normally be running.  Frames are held with
+               camera_manager->hold_next_frame_for(), so they count
+               against the get_num_framebuffers() - 1 limit.  queue_size
+               is the number of frames which can wait in the queue; zero
+               chooses get_num_framebuffers() - 2, which leaves the thread
+               one buffer to dequeue into.  When the queue is full the
+               newest frame is given back to the camera and counted as
+               dropped.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int start(const std::shared_ptr<camwire> &camera_manager, const Camwire_bus_handle_ptr &c_handle, const int queue_size = 0);
+            /* Stops the acquisition thread and gives back every frame
+               still in the queue.  Frames already popped must still be
+               released with release().  Returns CAMWIRE_SUCCESS on
+               success or CAMWIRE_FAILURE on failure. */
+            int stop();
+            /* Returns 1 if the acquisition thread is running, 0 otherwise. */
+            int is_running();
+            /* Sets buf_ptr to the oldest frame in the queue and returns
+               immediately.  buffer_lag is set to the number of frames
+               which were waiting in the DMA ring behind it when it was
+               dequeued.  If the queue is empty buf_ptr is set to the null
+               pointer.  Must be called from one consumer thread only.
+               Fails once the queue is empty if the acquisition thread
+               stopped because it could not dequeue a frame.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int try_pop(void **buf_ptr, int &buffer_lag);
+            /* Like try_pop() but waits up to timeout seconds for a frame.
+               On timeout buf_ptr is set to the null pointer and the
+               function succeeds.  Fails without waiting out the timeout
+               if the acquisition thread stops as for try_pop().  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int pop_for(void **buf_ptr, int &buffer_lag, const double timeout);
+            /* Gives the popped frame buffer buf_ptr back to the camera.
+               Fails if buf_ptr was not popped, or if the camera's DMA
+               ring was set up again since (see camwire::hold_next_frame()),
+               in which case the buffer must no longer be used.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int release(const void *buf_ptr);
+            /* Sets dropped to the number of frames given back unseen
+               because the queue was full, since start().  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int get_num_dropped(int64_t &dropped);
+
+        protected:
+            /* One queue entry: */
+            struct Queued_frame
+            {
+                void *buffer;
+                int buffer_lag;
+                uint64_t generation;  /* See camwire::get_frame_generation().*/
+            };
+
+            /* Body of the acquisition thread. */
+            void run();
+            /* Single-producer single-consumer ring.  Returns 1 if the
+               frame was queued, 0 if the queue is full. */
+            int push(const Queued_frame &entry);
+            /* Returns 1 and sets entry if a frame was taken from the
+               queue, 0 if the queue is empty. */
+            int pop(Queued_frame &entry);
+            /* Waits up to timeout seconds for the number of held frames
+               to drop below the DMA limit.  Returns 1 if there is room. */
+            int wait_for_room(const double timeout);
+
+        private:
+            std::shared_ptr<camwire> cam;
+            Camwire_bus_handle_ptr handle;
+            std::thread worker;
+            std::atomic<int> running;
+            std::atomic<int> failed;    /* Set if run() gave up on a dequeue error.*/
+            /* The ring has one more slot than its capacity, so that full
+               and empty can be told apart without a shared count: */
+            std::vector<Queued_frame> ring;
+            std::atomic<size_t> head;   /* Next slot to pop, owned by the consumer.*/
+            std::atomic<size_t> tail;   /* Next slot to push, owned by the producer.*/
+            std::atomic<int64_t> dropped_frames;
+            /* Frames popped and not yet released, so that release() knows
+               their generation: */
+            std::vector<Queued_frame> popped;
+            std::mutex popped_mutex;
+            int max_held;
+            /* Only used to sleep on, never to protect the ring: */
+            std::mutex wait_mutex;
+            std::condition_variable frame_ready;
+            std::condition_variable frame_released;
+            std::atomic<int> consumer_waiting;
+            std::atomic<int> producer_waiting;
+            camwireacquisition(const camwireacquisition &ca);
+            camwireacquisition& operator=(const camwireacquisition &ca);
+    };
+
+}
+
+#endif
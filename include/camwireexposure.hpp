@@ -0,0 +1,141 @@
+#ifndef CAMWIREEXPOSURE_HPP
+#define CAMWIREEXPOSURE_HPP
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+
+    Title: Header for camwireexposure.cpp
+
+    Description:
+    This Exposure module is an optional closed-loop exposure controller
+    for a single camera.  It owns a thread which follows the image
+    statistics worked out as frames are dequeued (see
+    camwire::set_image_stats()), steers the shutter and then the gain
+    towards a target brightness, and writes the camera registers only
+    when the change is worth it and not more often than a set number of
+    frames.  The capture thread never waits on these bus transactions.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+
+#include <camwire.hpp>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace camwire
+{
+    /* Controller settings, as passed to camwireexposure::start():
+
+       target:          Wanted mean brightness, as a fraction of full scale.
+
+       deadband:        Relative brightness error below which nothing is
+                        written, for example 0.1 for 10%.
+
+       max_clipped:     Fraction of clipped samples above which the image
+                        is taken as overexposed whatever its mean.
+
+       damping:         Fraction of each correction applied, between 0
+                        and 1, as a power of the wanted exposure ratio.
+                        1 corrects fully in one step.
+
+       interval:        Least number of frames between register writes,
+                        which also lets a new exposure reach the
+                        statistics before it is judged.
+
+       min_shutter,
+       max_shutter:     Shutter range in seconds.  A zero max_shutter
+                        means the frame period.
+
+       max_gain:        Linear gain factor of relative gain 1.0 (see
+                        camwire::set_gain()).  Gain is only raised once the
+                        shutter is at max_shutter.  1 never uses gain.
+
+       stats_step:      Grid step passed to camwire::set_image_stats().
+    */
+    struct Camwire_exposure_settings
+    {
+        double target;
+        double deadband;
+        double max_clipped;
+        double damping;
+        int interval;
+        double min_shutter, max_shutter;
+        double max_gain;
+        int stats_step;
+        Camwire_exposure_settings(): target(0.45), deadband(0.08), max_clipped(0.01), damping(0.7),
+            interval(4), min_shutter(1.0e-5), max_shutter(0), max_gain(4.0), stats_step(4) {}
+    };
+
+    class camwireexposure
+    {
+        public:
+            camwireexposure();
+            /* Stops the controller thread if it is still running. */
+            ~camwireexposure();
+            /* Turns image statistics on for the camera c_handle, which must
+               have been created with camera_manager->create(), and starts
+               the controller thread from the current shutter and gain.
+               Frames must be dequeued as usual for the controller to see
+               them.  Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE
+               on failure. */
+            int start(const std::shared_ptr<camwire> &camera_manager, const Camwire_bus_handle_ptr &c_handle,
+                      const Camwire_exposure_settings &settings = Camwire_exposure_settings());
+            /* Stops the controller thread, leaving the shutter and gain as
+               they are.  Image statistics stay on.  Returns CAMWIRE_SUCCESS
+               on success or CAMWIRE_FAILURE on failure. */
+            int stop();
+            /* Returns 1 if the controller thread is running, 0 otherwise. */
+            int is_running();
+            /* Changes the target brightness while running.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int set_target(const double target);
+            /* Sets writes to the number of shutter and gain register writes
+               made since start().  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int get_num_writes(int64_t &writes);
+
+        protected:
+            /* Body of the controller thread. */
+            void run();
+            /* Returns the factor by which the exposure should change to
+               bring the frame measured in stats to the target. */
+            double exposure_ratio(const Camwire_image_stats &stats);
+            /* Scales the exposure by ratio, shutter first, and writes the
+               registers that change.  Returns 1 if anything was written. */
+            int apply_ratio(const double ratio);
+
+        private:
+            std::shared_ptr<camwire> cam;
+            Camwire_bus_handle_ptr handle;
+            Camwire_exposure_settings config;
+            std::thread worker;
+            std::atomic<int> running;
+            std::atomic<double> target_level;
+            std::atomic<int64_t> num_writes;
+            double shutter;     /* As last read back from the camera.*/
+            double gain;        /* Relative, as last read back.*/
+            int gain_settable;  /* Flag, cleared when set_gain() fails.*/
+            camwireexposure(const camwireexposure &ce);
+            camwireexposure& operator=(const camwireexposure &ce);
+    };
+
+}
+
+#endif
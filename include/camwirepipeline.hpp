@@ -0,0 +1,118 @@
+#ifndef CAMWIREPIPELINE_HPP
+#define CAMWIREPIPELINE_HPP
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+
+    Title: Header for camwirepipeline.cpp
+
+    Description:
+    This Pipeline module chains the per-frame pixel operations of
+    Camwire (crop, conversion or demosaicing, inverse gamma and colour
+    correction) and runs them over horizontal strips of the frame small
+    enough to stay in the L2 cache.  Each strip goes through every stage
+    before the next strip is started, so the intermediate images never
+    reach main memory, and the strips are shared out over a pool of
+    threads.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+
+#include <camwire.hpp>
+#include <memory>
+#include <vector>
+
+namespace camwire
+{
+    class camwirethreadpool;
+
+    class camwirepipeline
+    {
+        public:
+            /* A pipeline which converts to CAMWIRE_OUTPUT_RGB8 on the
+               calling thread only. */
+            camwirepipeline();
+            ~camwirepipeline();
+            /* Sets the number of threads which run strips, the calling
+               thread included.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int set_num_threads(const int num_threads);
+            /* Sets the output layout and the Bayer interpolation method
+               used if the camera has a Bayer sensor.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int set_output(const Camwire_output output, const Camwire_demosaic method = CAMWIRE_DEMOSAIC_BILINEAR);
+            /* Restricts the output to the width by height rectangle at
+               left, top of the frame.  Both must be even on Bayer and YUV422
+               frames, and multiples of 4 on YUV411, so that the colour
+               layout is kept.  A zero width or height removes the crop.
+               Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on
+               failure. */
+            int set_crop(const int left, const int top, const int width, const int height);
+            /* Linearizes 8-bit components into 16 bits as inv_gamma() does,
+               scaling 255 to max_val.  The output layout must then be
+               CAMWIRE_OUTPUT_GRAY16 or CAMWIRE_OUTPUT_RGB16.  Zero removes
+               the stage.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int set_inv_gamma(const unsigned long max_val);
+            /* Applies the colour correction matrix coef, laid out like
+               Camwire_state::colour_coef, to colour output.  A null coef
+               removes the stage.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int set_colour_coefficients(const double coef[9]);
+            /* Runs the pipeline on the frame src, in the current geometry of
+               the camera c_handle, writing the output to dst with dst_stride
+               bytes between rows, or tightly packed rows if it is 0.
+               Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on
+               failure. */
+            int run(const Camwire_bus_handle_ptr &c_handle, const void *src, void *dst, const size_t dst_stride = 0);
+            /* Holds the next frame with camera_manager->hold_next_frame(),
+               runs the pipeline on it and gives it back.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int run_next_frame(const std::shared_ptr<camwire> &camera_manager, const Camwire_bus_handle_ptr &c_handle,
+                               void *dst, const size_t dst_stride, int &buffer_lag);
+
+        protected:
+            /* Runs every stage on output rows row_begin to row_end - 1,
+               with scratch memory owned by one thread.  Returns 1 on
+               success. */
+            int run_strip(const Camwire_geometry &geometry, const uint8_t *src, uint8_t *dst,
+                          const size_t dst_stride, const int row_begin, const int row_end,
+                          std::vector<uint8_t> &scratch);
+
+        private:
+            std::unique_ptr<camwirethreadpool> pool;
+            std::vector<std::vector<uint8_t> > scratch;   /* One per thread.*/
+            Camwire_output output;
+            Camwire_demosaic method;
+            int crop_left;
+            int crop_top;
+            int crop_width;
+            int crop_height;
+            unsigned long gamma_maxval;
+            uint16_t gamma_lut[256];
+            uint16_t linear_lut[256];   /* Widens 8-bit components otherwise.*/
+            int correct_colour;
+            int32_t colour_coef[9];   /* Q10.*/
+            camwirepipeline(const camwirepipeline &cp);
+            camwirepipeline& operator=(const camwirepipeline &cp);
+    };
+
+}
+
+#endif
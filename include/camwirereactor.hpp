@@ -0,0 +1,136 @@
+#ifndef CAMWIREREACTOR_HPP
+#define CAMWIREREACTOR_HPP
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+
+    Title: Header for camwirereactor.cpp
+
+    Description:
+    This Reactor module services many cameras from few threads.  The
+    capture file descriptor of every registered camera is watched in an
+    epoll set, and the cameras which have a frame ready are either
+    returned as a list or passed to a callback.  The cameras can be
+    split into shards, each with its own epoll set and thread.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+
+#include <camwirebus.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace camwire
+{
+    /* Called with the handle of a camera which has a frame ready.  The
+       epoll sets are level-triggered, so the callback should dequeue the
+       frame (with point_next_frame_poll(), hold_next_frame_poll() or
+       similar), otherwise it is called again straight away. */
+    typedef std::function<void (const Camwire_bus_handle_ptr &c_handle)> Camwire_frame_callback;
+
+    class camwirereactor
+    {
+        public:
+            camwirereactor();
+            /* Stops and destroys the reactor if that was not done. */
+            ~camwirereactor();
+            /* Creates num_shards epoll sets.  With one shard everything
+               runs in the thread calling wait() or run().  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int create(const int num_shards = 1);
+            /* Unregisters every camera and frees the epoll sets.  Must not
+               be called while run() is active.  Returns CAMWIRE_SUCCESS on
+               success or CAMWIRE_FAILURE on failure. */
+            int destroy();
+            /* Registers the capture file descriptor of the camera c_handle,
+               which must have been created with camwire::create().
+               Cameras are spread over the shards in turn.  The descriptor
+               changes whenever the camera is reconnected or its DMA
+               buffers are set up again, for example by
+               set_num_framebuffers(), set_frame_size(), set_pixel_coding(),
+               set_framerate() or apply_state(), after which the camera
+               must be removed and added again.  Returns CAMWIRE_SUCCESS on success or
+               CAMWIRE_FAILURE on failure. */
+            int add_handle(const Camwire_bus_handle_ptr &c_handle);
+            /* Registers every camera on the bus, as add_handle().  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int add_bus(camwirebus &bus);
+            /* Unregisters the camera c_handle.  Returns CAMWIRE_SUCCESS on
+               success or CAMWIRE_FAILURE on failure. */
+            int remove_handle(const Camwire_bus_handle_ptr &c_handle);
+            /* Waits up to timeout seconds (indefinitely if negative) for
+               any camera to have a frame ready, and fills ready with the
+               handles of those that do.  ready is left empty on timeout or
+               after stop().  Fails if the reactor was created with more
+               than one shard, whose cameras only run() services.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int wait(std::vector<Camwire_bus_handle_ptr> &ready, const double timeout);
+            /* Calls callback for every ready camera until stop() is called.
+               The first shard is serviced by the calling thread and each
+               further shard by a thread of its own, so the callback must
+               be thread-safe if there is more than one shard.  Returns
+               CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on failure. */
+            int run(const Camwire_frame_callback &callback);
+            /* Makes run() and wait() return as soon as possible.  Can be
+               called from any thread, including from the callback.
+               Returns CAMWIRE_SUCCESS on success or CAMWIRE_FAILURE on
+               failure. */
+            int stop();
+
+        protected:
+            /* A registered camera.  An empty handle marks a free slot: */
+            struct Slot
+            {
+                Camwire_bus_handle_ptr handle;
+                uint32_t serial;   /* Tells a reused slot from the old camera.*/
+            };
+
+            /* One epoll set with the cameras registered in it.  epoll
+               keeps the slot index and serial number of each camera, not
+               a pointer, so that a camera can be removed while a thread
+               is waiting on the set: */
+            struct Shard
+            {
+                int epoll_fd;
+                std::vector<Slot> slots;
+            };
+
+            /* Waits on one shard and collects its ready cameras. */
+            int wait_shard(Shard &shard, std::vector<Camwire_bus_handle_ptr> &ready, const int timeout_ms);
+            /* Services one shard until stop(). */
+            int run_shard(Shard &shard, const Camwire_frame_callback &callback);
+
+        private:
+            std::vector<std::unique_ptr<Shard> > shards;
+            int next_shard;
+            uint32_t next_serial;
+            int wakeup_fd;   /* eventfd registered in every shard, for stop().*/
+            std::atomic<int> stopping;
+            std::mutex registry_mutex;
+            camwirereactor(const camwirereactor &cr);
+            camwirereactor& operator=(const camwirereactor &cr);
+    };
+
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include <dc1394/vendor/avt.h>
 #include <camwire_config.hpp>
 #include <camwire.hpp>
+#include <camwire_kernels.hpp>
+#include <camwire_threadpool.hpp>
 #include <cstring>
 #include <unistd.h>         //sleep function
 #include <cmath>            //log function
@@ -8,6 +10,11 @@
 #include <netinet/in.h>     //htons on Linux
 #include <climits>          //definition of INT_MAX
 #include <sstream>         //stringstream
+#include <algorithm>        //std::find
+#include <chrono>           //steady_clock for timed waits
+#include <cerrno>           //EINTR
+#include <poll.h>           //poll on the capture file descriptor
+#include <ctime>            //clock_gettime
 
 camwire::camwire::camwire()
 {
@@ -507,7 +514,7 @@ int camwire::camwire::sleep_frametime(const Camwire_bus_handle_ptr &c_handle, co
 
     try
     {
-        //ERROR_IF_CAMWIRE_FAIL(camwire_get_framerate(c_handle, &frame_rate));
+        ERROR_IF_CAMWIRE_FAIL(get_framerate(c_handle, frame_rate));
         if(frame_rate != 0.0f)                  /* Avoiding division by 0 */
             sleep_period = multiple/frame_rate;
         nap.tv_sec = (time_t) sleep_period; 	/* Trunc. to integer.*/
@@ -547,11 +554,9 @@ int camwire::camwire::connect_cam(const Camwire_bus_handle_ptr &c_handle, Camwir
 
         dc1394framerates_t framerate_list;
         dc1394framerate_t  frame_rate_index;
-        dc1394color_codings_t coding_list;
-        dc1394color_coding_t  color_id;
         Camwire_pixel actual_coding;
+        uint32_t actual_width = set->width, actual_height = set->height;
         double actual_frame_rate = 0.0f;
-        uint32_t num_packets, packet_size;
         int depth = 0;
         if(fixed_image_size(video_mode))    /* Format 0, 1 or 2 */
         {
@@ -580,6 +585,11 @@ int camwire::camwire::connect_cam(const Camwire_bus_handle_ptr &c_handle, Camwir
             internal_status->num_dma_buffers = set->num_frame_buffers;
             actual_coding = convert_videomode2pixelcoding(video_mode);
             actual_frame_rate = convert_index2framerate(frame_rate_index);
+            ERROR_IF_DC1394_FAIL(
+                dc1394_get_image_size_from_video_mode(c_handle->camera.get(),
+                                      video_mode,
+                                      &actual_width,
+                                      &actual_height));
         }
         else if (variable_image_size(video_mode))   /* Format 7 */
         {
@@ -591,79 +601,7 @@ int camwire::camwire::connect_cam(const Camwire_bus_handle_ptr &c_handle, Camwir
             ERROR_IF_DC1394_FAIL(dc1394_video_set_iso_speed(c_handle->camera.get(), static_cast<dc1394speed_t>(convert_busspeed2dc1394(cfg->bus_speed))));
             ERROR_IF_DC1394_FAIL(dc1394_video_set_mode(c_handle->camera.get(), video_mode));
 
-            /* Set up the color_coding_id before calling
-               dc1394_capture_setup(), otherwise the wrong DMA buffer size
-               may be allocated: */
-            ERROR_IF_DC1394_FAIL(
-                dc1394_format7_get_color_codings(c_handle->camera.get(),
-                                 video_mode,
-                                 &coding_list));
-
-            if(coding_list.num == 0)
-            {
-                DPRINTF("dc1394_format7_get_color_codings returned an empty list");
-                return CAMWIRE_FAILURE;
-            }
-
-            color_id = (convert_pixelcoding2colorid(set->coding, coding_list));
-            if (color_id == 0)
-            {
-                DPRINTF("Pixel colour coding is invalid or not supported by the camera.");
-                return CAMWIRE_FAILURE;
-            }
-            ERROR_IF_DC1394_FAIL(
-                dc1394_format7_set_color_coding(
-                c_handle->camera.get(),
-                video_mode,
-                color_id));
-            actual_coding = convert_colorid2pixelcoding(color_id);
-
-            /* Calculate the packet size from the wanted frame rate.  But
-               first set the image size because that (together with
-               color_id) can affect the max_bytes read by
-              dc1394_format7_get_packet_parameters() (or total_bytes read by
-              dc1394_format7_get_total_bytes()) in
-               convert_numpackets2packetsize(): */
-            ERROR_IF_DC1394_FAIL(
-                dc1394_format7_set_image_position(
-                c_handle->camera.get(),
-                video_mode,
-                set->left, set->top));  /* So that _image_size() doesn't fail.*/
-            ERROR_IF_DC1394_FAIL(
-                dc1394_format7_set_image_size(
-                c_handle->camera.get(),
-                video_mode,
-                set->width, set->height));  /* PACKET_PARA_INQ is now valid. */
-
-            num_packets = convert_framerate2numpackets(c_handle, set->frame_rate);
-
-            ERROR_IF_ZERO(num_packets);
-            packet_size = convert_numpackets2packetsize(c_handle,
-                                    num_packets,
-                                    set->width,
-                                    set->height,
-                                    actual_coding);
-
-            ERROR_IF_ZERO(packet_size);
-
-            /* Set up the camera and DMA buffers: */
-            ERROR_IF_DC1394_FAIL(
-                dc1394_format7_set_packet_size(
-                c_handle->camera.get(),
-                video_mode,
-                packet_size));
-            ERROR_IF_DC1394_FAIL(
-                dc1394_capture_setup(c_handle->camera.get(),
-                         set->num_frame_buffers,
-                         DC1394_CAPTURE_FLAGS_DEFAULT));
-            num_packets = convert_packetsize2numpackets(c_handle,
-                                    packet_size,
-                                    set->width,
-                                    set->height,
-                                    actual_coding);
-            ERROR_IF_ZERO(num_packets);
-            actual_frame_rate =
-                convert_numpackets2framerate(c_handle, num_packets);
+            ERROR_IF_CAMWIRE_FAIL(setup_format7_capture(c_handle, video_mode, set, actual_coding, actual_frame_rate));
         }
         else
         {
@@ -671,16 +609,17 @@ int camwire::camwire::connect_cam(const Camwire_bus_handle_ptr &c_handle, Camwir
             return CAMWIRE_FAILURE;
         }
 
-        internal_status->camera_connected = 1;
-        internal_status->frame = 0;
-        internal_status->frame_lock = 0;
-        internal_status->num_dma_buffers = set->num_frame_buffers;
+        ERROR_IF_CAMWIRE_FAIL(capture_connected(c_handle, set->num_frame_buffers, actual_width, actual_height,
+                                                actual_coding, actual_frame_rate));
         /* Find out camera capabilities (which should only be done after
            setting up the format and mode above): */
         internal_status->extras->single_shot_capable = (c_handle->camera->one_shot_capable != DC1394_FALSE ? 1 : 0);
         internal_status->extras->gamma_capable = probe_camera_gamma(c_handle);
         internal_status->extras->colour_corr_capable = probe_camera_colour_correction(c_handle);
         internal_status->extras->tiling_value = probe_camera_tiling(c_handle);
+        internal_status->geometry.tiling = (variable_image_size(video_mode) ?
+                                            internal_status->extras->tiling_value :
+                                            CAMWIRE_TILING_INVALID);
         ERROR_IF_DC1394_FAIL(dc1394_feature_get_all(c_handle->camera.get(), &internal_status->feature_set));
         /* Update DMA-affected shadow states not done in
            set_non_dma_registers() calls below: */
@@ -713,6 +652,195 @@ int camwire::camwire::connect_cam(const Camwire_bus_handle_ptr &c_handle, Camwir
     }
 }
 
+int camwire::camwire::setup_format7_capture(const Camwire_bus_handle_ptr &c_handle, const dc1394video_mode_t video_mode,
+                                            const Camwire_state_ptr &set, Camwire_pixel &actual_coding,
+                                            double &actual_frame_rate)
+{
+    try
+    {
+        dc1394color_codings_t coding_list;
+        dc1394color_coding_t  color_id;
+        uint32_t num_packets, packet_size;
+
+        /* Set up the color_coding_id before calling
+           dc1394_capture_setup(), otherwise the wrong DMA buffer size
+           may be allocated: */
+        ERROR_IF_DC1394_FAIL(
+            dc1394_format7_get_color_codings(c_handle->camera.get(),
+                             video_mode,
+                             &coding_list));
+
+        if(coding_list.num == 0)
+        {
+            DPRINTF("dc1394_format7_get_color_codings returned an empty list");
+            return CAMWIRE_FAILURE;
+        }
+
+        color_id = (convert_pixelcoding2colorid(set->coding, coding_list));
+        if (color_id == 0)
+        {
+            DPRINTF("Pixel colour coding is invalid or not supported by the camera.");
+            return CAMWIRE_FAILURE;
+        }
+        ERROR_IF_DC1394_FAIL(
+            dc1394_format7_set_color_coding(
+            c_handle->camera.get(),
+            video_mode,
+            color_id));
+        actual_coding = convert_colorid2pixelcoding(color_id);
+
+        /* Calculate the packet size from the wanted frame rate.  But
+           first set the image size because that (together with
+           color_id) can affect the max_bytes read by
+          dc1394_format7_get_packet_parameters() (or total_bytes read by
+          dc1394_format7_get_total_bytes()) in
+           convert_numpackets2packetsize(): */
+        ERROR_IF_DC1394_FAIL(
+            dc1394_format7_set_image_position(
+            c_handle->camera.get(),
+            video_mode,
+            set->left, set->top));  /* So that _image_size() doesn't fail.*/
+        ERROR_IF_DC1394_FAIL(
+            dc1394_format7_set_image_size(
+            c_handle->camera.get(),
+            video_mode,
+            set->width, set->height));  /* PACKET_PARA_INQ is now valid. */
+
+        num_packets = convert_framerate2numpackets(c_handle, set->frame_rate);
+
+        ERROR_IF_ZERO(num_packets);
+        packet_size = convert_numpackets2packetsize(c_handle,
+                                num_packets,
+                                set->width,
+                                set->height,
+                                actual_coding);
+
+        ERROR_IF_ZERO(packet_size);
+
+        /* Set up the camera and DMA buffers: */
+        ERROR_IF_DC1394_FAIL(
+            dc1394_format7_set_packet_size(
+            c_handle->camera.get(),
+            video_mode,
+            packet_size));
+        ERROR_IF_DC1394_FAIL(
+            dc1394_capture_setup(c_handle->camera.get(),
+                     set->num_frame_buffers,
+                     DC1394_CAPTURE_FLAGS_DEFAULT));
+        num_packets = convert_packetsize2numpackets(c_handle,
+                                packet_size,
+                                set->width,
+                                set->height,
+                                actual_coding);
+        ERROR_IF_ZERO(num_packets);
+        actual_frame_rate =
+            convert_numpackets2framerate(c_handle, num_packets);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to set up Format 7 capture");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::capture_connected(const Camwire_bus_handle_ptr &c_handle, const int num_frame_buffers,
+                                        const int width, const int height, const Camwire_pixel coding,
+                                        const double frame_rate)
+{
+    try
+    {
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        internal_status->camera_connected = 1;
+        internal_status->frame = 0;
+        internal_status->frame_lock = 0;
+        internal_status->num_dma_buffers = num_frame_buffers;
+        {
+            std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+            /* Reserve room for every frame that can be held, so that
+               dequeueing never allocates: */
+            internal_status->held_frames.clear();
+            internal_status->held_frames.reserve(num_frame_buffers);
+            /* Frames still held from the old ring can no longer be
+               released: */
+            ++internal_status->capture_generation;
+        }
+        ERROR_IF_CAMWIRE_FAIL(update_geometry(c_handle, width, height, coding));
+        /* Gap detection in the capture statistics starts afresh: */
+        internal_status->frame_period = (frame_rate > 0.0 ? 1.0/frame_rate : 0.0);
+        internal_status->stats_timestamp = 0.0;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to record capture connection");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::pause_capture(const Camwire_bus_handle_ptr &c_handle, int &was_running)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        ERROR_IF_NULL(internal_status->current_set);
+        {
+            /* Tearing down the ring would pull the buffers out from under
+               whoever holds them: */
+            std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+            if (!internal_status->held_frames.empty())
+            {
+                DPRINTF("Can't set up the DMA buffers again while frames are held.");
+                return CAMWIRE_FAILURE;
+            }
+        }
+        was_running = internal_status->current_set->running;
+        if (was_running)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_run_stop(c_handle, 0));
+            ERROR_IF_CAMWIRE_FAIL(wait_for_stop(c_handle));
+        }
+        disconnect_cam(c_handle);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to pause capture");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::resume_capture(const Camwire_bus_handle_ptr &c_handle, const int was_running, const double frame_rate)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        ERROR_IF_NULL(internal_status->current_set);
+        const int num_frame_buffers = internal_status->current_set->num_frame_buffers;
+        ERROR_IF_DC1394_FAIL(
+            dc1394_capture_setup(c_handle->camera.get(),
+                     num_frame_buffers,
+                     DC1394_CAPTURE_FLAGS_DEFAULT));
+        const Camwire_geometry &geometry = internal_status->geometry;
+        ERROR_IF_CAMWIRE_FAIL(capture_connected(c_handle, num_frame_buffers, geometry.width, geometry.height,
+                                                geometry.coding, frame_rate));
+        internal_status->current_set->frame_rate = frame_rate;
+        if (was_running)
+            ERROR_IF_CAMWIRE_FAIL(set_run_stop(c_handle, 1));
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to resume capture");
+        return CAMWIRE_FAILURE;
+    }
+}
+
 int camwire::camwire::reconnect_cam(const Camwire_bus_handle_ptr &c_handle, Camwire_conf_ptr &cfg, const Camwire_state_ptr &set)
 {
     try
@@ -720,7 +848,7 @@ int camwire::camwire::reconnect_cam(const Camwire_bus_handle_ptr &c_handle, Camw
         if (set->running)
         {
             ERROR_IF_CAMWIRE_FAIL(set_run_stop(c_handle, 0));
-            ERROR_IF_CAMWIRE_FAIL(sleep_frametime(c_handle, 1.5));
+            ERROR_IF_CAMWIRE_FAIL(wait_for_stop(c_handle));
         }
         disconnect_cam(c_handle);
         ERROR_IF_CAMWIRE_FAIL(connect_cam(c_handle, cfg, set));
@@ -733,6 +861,46 @@ int camwire::camwire::reconnect_cam(const Camwire_bus_handle_ptr &c_handle, Camw
     }
 }
 
+int camwire::camwire::state_changes(const Camwire_state &from, const Camwire_state &to)
+{
+    int changes = 0;
+    if (from.num_frame_buffers != to.num_frame_buffers)
+        changes |= CAMWIRE_CHANGED_NUM_BUFFERS;
+    if (from.gain != to.gain)
+        changes |= CAMWIRE_CHANGED_GAIN;
+    if (from.brightness != to.brightness)
+        changes |= CAMWIRE_CHANGED_BRIGHTNESS;
+    if (!std::equal(from.white_balance, from.white_balance + 2, to.white_balance))
+        changes |= CAMWIRE_CHANGED_WHITE_BALANCE;
+    if (from.gamma != to.gamma)
+        changes |= CAMWIRE_CHANGED_GAMMA;
+    if (from.colour_corr != to.colour_corr)
+        changes |= CAMWIRE_CHANGED_COLOUR_CORR;
+    if (!std::equal(from.colour_coef, from.colour_coef + 9, to.colour_coef))
+        changes |= CAMWIRE_CHANGED_COLOUR_COEF;
+    if (from.left != to.left || from.top != to.top)
+        changes |= CAMWIRE_CHANGED_FRAME_OFFSET;
+    if (from.width != to.width || from.height != to.height)
+        changes |= CAMWIRE_CHANGED_FRAME_SIZE;
+    if (from.coding != to.coding)
+        changes |= CAMWIRE_CHANGED_PIXEL_CODING;
+    if (from.frame_rate != to.frame_rate)
+        changes |= CAMWIRE_CHANGED_FRAME_RATE;
+    if (from.shutter != to.shutter)
+        changes |= CAMWIRE_CHANGED_SHUTTER;
+    if (from.external_trigger != to.external_trigger)
+        changes |= CAMWIRE_CHANGED_TRIGGER_SOURCE;
+    if (from.trigger_polarity != to.trigger_polarity)
+        changes |= CAMWIRE_CHANGED_TRIGGER_POLARITY;
+    if (from.single_shot != to.single_shot)
+        changes |= CAMWIRE_CHANGED_SINGLE_SHOT;
+    if (from.running != to.running)
+        changes |= CAMWIRE_CHANGED_RUNNING;
+    if (from.shadow != to.shadow)
+        changes |= CAMWIRE_CHANGED_SHADOW;
+    return changes;
+}
+
 void camwire::camwire::disconnect_cam(const Camwire_bus_handle_ptr &c_handle)
 {    
     try
@@ -742,12 +910,7 @@ void camwire::camwire::disconnect_cam(const Camwire_bus_handle_ptr &c_handle)
         {
             if (internal_status->camera_connected)
             {
-                if (internal_status->frame_lock)
-                {
-                    dc1394_capture_enqueue(c_handle->camera.get(), internal_status->frame);
-                    internal_status->frame = 0;
-                    internal_status->frame_lock = 0;
-                }
+                capture_enqueue_all(c_handle);
                 dc1394_capture_stop(c_handle->camera.get());
             }
             internal_status->camera_connected = 0;
@@ -766,13 +929,7 @@ void camwire::camwire::free_internals(const Camwire_bus_handle_ptr &c_handle)
         User_handle internal_status = c_handle->userdata;
         if (internal_status)
         {
-            if (internal_status->frame_lock)
-            {
-                dc1394_capture_enqueue(c_handle->camera.get(),
-                           internal_status->frame);
-                internal_status->frame = 0;
-                internal_status->frame_lock = 0;
-            }
+            capture_enqueue_all(c_handle);
         }
     }
     catch(std::runtime_error &re)
@@ -1527,6 +1684,93 @@ int camwire::camwire::pixel_depth(const Camwire_pixel coding, int &depth)
     return CAMWIRE_SUCCESS;
 }
 
+int camwire::camwire::wait_for_stop(const Camwire_bus_handle_ptr &c_handle)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        double period = internal_status->frame_period;
+        if (period <= 0.0)
+        {
+            double frame_rate = 0.0;
+            if (get_framerate(c_handle, frame_rate) == CAMWIRE_SUCCESS && frame_rate > 0.0)
+                period = 1.0/frame_rate;
+        }
+        /* A frame in flight can take up to a whole exposure longer than
+           the frame period, and the shutter may be open for longer than
+           the frame period: */
+        double frame_time = period;
+        if (internal_status->current_set && internal_status->current_set->shutter > 0.0)
+            frame_time += internal_status->current_set->shutter;
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(std::max(STOP_TIMEOUT_FRAMES*frame_time, STOP_TIMEOUT_MIN)));
+
+        /* The transmission register: */
+        for (;;)
+        {
+            dc1394switch_t iso_en;
+            ERROR_IF_DC1394_FAIL(dc1394_video_get_transmission(c_handle->camera.get(), &iso_en));
+            if (iso_en == DC1394_OFF)
+                break;
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                DPRINTF("Camera did not stop transmitting in time.");
+                return CAMWIRE_FAILURE;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        /* The capture file descriptor, which stays readable while a frame
+           waits in the ring: */
+        if (!internal_status->camera_connected)
+            return CAMWIRE_SUCCESS;
+        struct pollfd capture_fd;
+        capture_fd.fd = dc1394_capture_get_fileno(c_handle->camera.get());
+        capture_fd.events = POLLIN;
+        if (capture_fd.fd < 0)
+            return CAMWIRE_SUCCESS;
+        const int quiet_ms = static_cast<int>(std::ceil(frame_time*1.0e3)) + 1;
+        for (;;)
+        {
+            int remaining_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   deadline - std::chrono::steady_clock::now()).count());
+            if (remaining_ms <= 0)
+            {
+                DPRINTF("Capture did not go quiet in time.");
+                return CAMWIRE_SUCCESS;  /* Torn down regardless.*/
+            }
+            capture_fd.revents = 0;
+            int ready = poll(&capture_fd, 1, std::min(quiet_ms, remaining_ms));
+            if (ready == 0)
+                return CAMWIRE_SUCCESS;  /* Quiet for a frame period.*/
+            if (ready < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                DPRINTF("poll() on the capture file descriptor failed.");
+                return CAMWIRE_FAILURE;
+            }
+
+            dc1394video_frame_t *frame = 0;
+            if (dc1394_capture_dequeue(c_handle->camera.get(), DC1394_CAPTURE_POLICY_POLL, &frame) != DC1394_SUCCESS ||
+                !frame)
+            {
+                return CAMWIRE_SUCCESS;  /* Nothing that can be drained.*/
+            }
+            ERROR_IF_DC1394_FAIL(dc1394_capture_enqueue(c_handle->camera.get(), frame));
+        }
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to wait for the camera to stop");
+        return CAMWIRE_FAILURE;
+    }
+}
+
 /* To-Do: the enabling of capabilities could be optimized passing to feature_is_usable() a structure
     containing all the possible features and probing them, instead of assigning pointers and recalling
     same functions. Here the DY concept could be exploited at its maximum */
@@ -1633,27 +1877,20 @@ int camwire::camwire::set_non_dma_registers(const Camwire_bus_handle_ptr &c_hand
         if (internal_status->extras->colour_corr_capable)
         {
             ERROR_IF_CAMWIRE_FAIL(set_colour_correction(c_handle, set->colour_corr));
+            ERROR_IF_CAMWIRE_FAIL(set_colour_coefficients(c_handle, set->colour_coef));
         }
-        else
-        {
-            shadow_state->colour_corr = 0;
-        }
-
-        if (internal_status->extras->colour_corr_capable)
+        else if (set->colour_corr)
         {
+            /* Done on the host, as asked for: */
             ERROR_IF_CAMWIRE_FAIL(set_colour_coefficients(c_handle, set->colour_coef));
+            ERROR_IF_CAMWIRE_FAIL(set_colour_correction(c_handle, 1));
         }
         else
         {
-            shadow_state->colour_coef[0] = 1;
-            shadow_state->colour_coef[1] = 0;
-            shadow_state->colour_coef[2] = 0;
-            shadow_state->colour_coef[3] = 0;
-            shadow_state->colour_coef[4] = 1;
-            shadow_state->colour_coef[5] = 0;
-            shadow_state->colour_coef[6] = 0;
-            shadow_state->colour_coef[7] = 0;
-            shadow_state->colour_coef[8] = 1;
+            /* Off, with the identity matrix ready for when it is switched on: */
+            const double identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+            ERROR_IF_CAMWIRE_FAIL(set_colour_coefficients(c_handle, identity));
+            shadow_state->colour_corr = 0;
         }
 
         /* Gamma: */
@@ -1685,7 +1922,7 @@ int camwire::camwire::set_non_dma_registers(const Camwire_bus_handle_ptr &c_hand
            dc1394_video_set_framerate() or dc1394_format7_set_roi() and
            because they could cause infinite recursion since they themselves
            contain calls to (re)connect_cam() which call this function.
-           camwire_set_frame_offset() is a bit different in that it is set
+           set_frame_offset() is a bit different in that it is set
            up with dc1394_format7_set_roi() but does not require a
            reconnect_cam() when it changes. */
 
@@ -1741,7 +1978,8 @@ int camwire::camwire::get_captureframe(const Camwire_bus_handle_ptr &c_handle, s
     try
     {
         ERROR_IF_NULL(c_handle->userdata);
-        frame.reset(c_handle->userdata->frame);
+        /* The frame belongs to libdc1394, so must not be deleted: */
+        frame.reset(c_handle->userdata->frame, [](dc1394video_frame_t *) {});
         return CAMWIRE_SUCCESS;
     }
     catch(std::runtime_error &re)
@@ -1751,63 +1989,443 @@ int camwire::camwire::get_captureframe(const Camwire_bus_handle_ptr &c_handle, s
     }
 }
 
-int camwire::camwire::component_depth(const Camwire_pixel coding)
-{
-    switch (coding)
-    {
-        case CAMWIRE_PIXEL_MONO8:
-        case CAMWIRE_PIXEL_YUV411:
-        case CAMWIRE_PIXEL_YUV422:
-        case CAMWIRE_PIXEL_YUV444:
-        case CAMWIRE_PIXEL_RGB8:
-        case CAMWIRE_PIXEL_RAW8:
-                                return 8;
-        case CAMWIRE_PIXEL_MONO16:
-        case CAMWIRE_PIXEL_RGB16:
-        case CAMWIRE_PIXEL_MONO16S:
-        case CAMWIRE_PIXEL_RGB16S:
-        case CAMWIRE_PIXEL_RAW16:
-                                return 16;
-        default:
-                                return 0;
-    }
-}
-
-dc1394video_mode_t camwire::camwire::get_1394_video_mode(const Camwire_bus_handle_ptr &c_handle)
+int camwire::camwire::capture_dequeue(const Camwire_bus_handle_ptr &c_handle, const dc1394capture_policy_t policy, dc1394video_frame_t *&frame)
 {
     try
     {
-       Camwire_conf_ptr config(new Camwire_conf);
-       if(get_config(c_handle, config) != CAMWIRE_SUCCESS)
-           return DC1394_VIDEO_MODE_INVALID;
-       /* FIXME: Need a better way of checking cache initialization than bus_speed: */
-       if (config->bus_speed == 0)
-           return DC1394_VIDEO_MODE_INVALID;
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        frame = 0;
+        {
+            std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+            /* libdc1394 needs at least one free buffer to receive into: */
+            if (static_cast<int>(internal_status->held_frames.size()) >= internal_status->num_dma_buffers - 1)
+            {
+                DPRINTF("Can't hold more than num_dma_buffers - 1 frames.");
+                return CAMWIRE_FAILURE;
+            }
+        }
 
-       return convert_format_mode2dc1394video_mode(config->format, config->mode);
-       /* FIXME: Kludge to get it working. Redo video_mode in config. */
+        /* Don't keep the lock while waiting, so that other threads can
+           release their frames in the meantime: */
+        int dc1394_return = dc1394_capture_dequeue(c_handle->camera.get(), policy, &frame);
+        if (dc1394_return != DC1394_SUCCESS)
+        {
+            frame = 0;
+            DPRINTF("dc1394_capture_dequeue() failed");
+            return CAMWIRE_FAILURE;
+        }
+        if (!frame)
+            return CAMWIRE_SUCCESS;  /* Polled, and no frame is ready.*/
+        record_frame_stats(internal_status, frame);
+
+        /* In latest-only mode, recycle the frame as long as a newer one is
+           already waiting behind it: */
+        while (internal_status->latest_only && frame->frames_behind > 0)
+        {
+            ++internal_status->frame_number;
+            ++internal_status->frames_skipped;
+            {
+                std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+                ERROR_IF_DC1394_FAIL(dc1394_capture_enqueue(c_handle->camera.get(), frame));
+            }
+            dc1394_return = dc1394_capture_dequeue(c_handle->camera.get(), policy, &frame);
+            if (dc1394_return != DC1394_SUCCESS)
+            {
+                frame = 0;
+                DPRINTF("dc1394_capture_dequeue() failed");
+                return CAMWIRE_FAILURE;
+            }
+            if (!frame)
+                return CAMWIRE_SUCCESS;
+            record_frame_stats(internal_status, frame);
+        }
+
+        int ring_used;
+        {
+            std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+            internal_status->held_frames.push_back(frame);
+            ring_used = internal_status->held_frames.size() + frame->frames_behind;
+        }
+        if (ring_used > internal_status->ring_high_water)
+            internal_status->ring_high_water = ring_used;
+
+        /*  Record buffer timestamp for later use by camwire_get_timestamp(),
+            because we don't want to assume that dc1394_capture_enqueue()
+            does not mess with its frame arg:*/
+        internal_status->dma_timestamp = frame->timestamp*1.0e-6;
+        /* Increment the frame number if we have a frame: */
+        ++internal_status->frame_number;
 
+        /* Keep the host clock correlation fresh, without a clock query on
+           every frame: */
+        if (internal_status->clock_sync.clock != CAMWIRE_CLOCK_DC1394 &&
+            internal_status->frame_number >= internal_status->clock_sync.next_sync_frame)
+            ERROR_IF_CAMWIRE_FAIL(sync_timestamp_clock(c_handle));
+        return CAMWIRE_SUCCESS;
     }
     catch(std::runtime_error &re)
     {
-        DPRINTF("Failed to get IEEE 1394 image video_mode");
-        return DC1394_VIDEO_MODE_INVALID;
+        DPRINTF("Failed to dequeue frame");
+        return CAMWIRE_FAILURE;
     }
 }
 
-int camwire::camwire::get_feature_capability(const Camwire_bus_handle_ptr &c_handle, std::shared_ptr<dc1394feature_info_t> &cap, const dc1394feature_t feature)
+void camwire::camwire::correct_frame_colour(const User_handle &internal_status, dc1394video_frame_t *frame,
+                                            const int row_begin, const int row_end)
 {
-    try
-    {
-        User_handle internal_status = c_handle->userdata;
-        ERROR_IF_NULL(internal_status);
-        #ifdef CAMWIRE_DEBUG
-            if (internal_status->feature_set.feature[feature-DC1394_FEATURE_MIN].id != feature)
-            {
-                DPRINTF("Requested feature does not match feature_set.id.");
-                return 0;
-            }
-        #endif
+    /* Only for cameras which cannot do it themselves: */
+    if (internal_status->extras->colour_corr_capable || !internal_status->current_set->colour_corr)
+        return;
+    const Camwire_geometry &geometry = internal_status->geometry;
+    if (geometry.coding != CAMWIRE_PIXEL_RGB8 && geometry.coding != CAMWIRE_PIXEL_RGB16)
+        return;
+    kernels::colour_correct_rows(frame->image, geometry.stride, geometry.width,
+                                 geometry.component_depth/8, false,
+                                 internal_status->host_colour_coef, row_begin, row_end);
+}
+
+int camwire::camwire::stats_settings(const User_handle &internal_status, int &step, int region[4])
+{
+    int roi[4];
+    {
+        std::lock_guard<std::mutex> lock(internal_status->stats_mutex);
+        if (!internal_status->stats_enabled)
+            return 0;
+        step = internal_status->stats_step;
+        std::copy(internal_status->stats_roi, internal_status->stats_roi + 4, roi);
+    }
+
+    /* The region is clipped to the frame here, since the frame size can
+       change after it is set: */
+    const Camwire_geometry &geometry = internal_status->geometry;
+    region[0] = std::min(roi[0], geometry.width);
+    region[1] = std::min(roi[1], geometry.height);
+    region[2] = (roi[2] > 0) ? std::min(roi[2], geometry.width - region[0]) : geometry.width - region[0];
+    region[3] = (roi[3] > 0) ? std::min(roi[3], geometry.height - region[1]) : geometry.height - region[1];
+    return 1;
+}
+
+void camwire::camwire::publish_stats(const User_handle &internal_status, Camwire_image_stats &stats)
+{
+    stats.frame_number = internal_status->frame_number;
+    /* Copied outside the lock, so that readers only wait for a pointer
+       swap: */
+    std::shared_ptr<const Camwire_image_stats> published = std::make_shared<Camwire_image_stats>(stats);
+    std::lock_guard<std::mutex> lock(internal_status->stats_mutex);
+    internal_status->image_stats.swap(published);
+    internal_status->stats_ready.notify_all();
+}
+
+void camwire::camwire::measure_frame(const User_handle &internal_status, const dc1394video_frame_t *frame)
+{
+    int step, region[4];
+    if (!stats_settings(internal_status, step, region))
+        return;
+    const Camwire_geometry &geometry = internal_status->geometry;
+    Camwire_image_stats stats;
+    if (!kernels::image_stats(frame->image, geometry.stride, geometry.width, geometry.coding,
+                              geometry.tiling, region[0], region[1], region[2], region[3], step, stats))
+        return;
+    publish_stats(internal_status, stats);
+}
+
+void camwire::camwire::deliver_frame(const User_handle &internal_status, dc1394video_frame_t *frame)
+{
+    correct_frame_colour(internal_status, frame, 0, internal_status->geometry.height);
+    measure_frame(internal_status, frame);
+    ++internal_status->frames_delivered;
+}
+
+void camwire::camwire::record_frame_stats(const User_handle &internal_status, const dc1394video_frame_t *frame)
+{
+    int lag = frame->frames_behind;
+    internal_status->last_lag = lag;
+    if (lag > internal_status->max_lag)
+        internal_status->max_lag = lag;
+
+    /* A gap of more than one and a half frame periods since the previous
+       frame means that frames were lost.  Triggered and single-shot
+       cameras have no fixed period, so gaps are meaningless for them: */
+    double timestamp = frame->timestamp*1.0e-6;
+    double period = internal_status->frame_period;
+    if (internal_status->stats_timestamp > 0.0 && period > 0.0 &&
+        !(internal_status->current_set && (internal_status->current_set->external_trigger ||
+                                           internal_status->current_set->single_shot)))
+    {
+        double gap = timestamp - internal_status->stats_timestamp;
+        if (gap > 1.5*period)
+            internal_status->frames_dropped += static_cast<int64_t>(gap/period + 0.5) - 1;
+    }
+    internal_status->stats_timestamp = timestamp;
+}
+
+int camwire::camwire::sync_timestamp_clock(const Camwire_bus_handle_ptr &c_handle)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        Camwire_clock_sync &sync = internal_status->clock_sync;
+        clockid_t clock_id = (sync.clock == CAMWIRE_CLOCK_MONOTONIC ? CLOCK_MONOTONIC : CLOCK_REALTIME);
+
+        /* Bracket the libdc1394 clock reading with two host clock readings
+           and take the midpoint, which halves the error: */
+        struct timespec before, after;
+        uint32_t cycle_timer;
+        uint64_t local_time;
+        ERROR_IF_ZERO(clock_gettime(clock_id, &before) == 0);
+        if (dc1394_read_cycle_timer(c_handle->camera.get(), &cycle_timer, &local_time) != DC1394_SUCCESS)
+        {
+            /* libdc1394 time stamps come from the system time of day, so
+               that will do if the cycle timer can't be read: */
+            struct timespec now;
+            ERROR_IF_ZERO(clock_gettime(CLOCK_REALTIME, &now) == 0);
+            local_time = static_cast<uint64_t>(now.tv_sec)*1000000 + now.tv_nsec/1000;
+        }
+        ERROR_IF_ZERO(clock_gettime(clock_id, &after) == 0);
+
+        double dc1394_time = local_time*1.0e-6;
+        double host_time = 0.5*((before.tv_sec + before.tv_nsec*1.0e-9) +
+                                (after.tv_sec + after.tv_nsec*1.0e-9));
+        double offset = host_time - dc1394_time;
+        if (sync.reference > 0.0 && dc1394_time > sync.reference)
+        {
+            /* Smooth the drift, because each sample has some jitter: */
+            double drift = (offset - sync.offset)/(dc1394_time - sync.reference);
+            sync.drift = (sync.drift == 0.0 ? drift : 0.9*sync.drift + 0.1*drift);
+        }
+        sync.reference = dc1394_time;
+        sync.offset = offset;
+        sync.next_sync_frame = internal_status->frame_number + CLOCK_SYNC_FRAMES;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to synchronize time stamp clock");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+double camwire::camwire::convert_dma_timestamp(const User_handle &internal_status, const double dma_time)
+{
+    const Camwire_clock_sync &sync = internal_status->clock_sync;
+    if (sync.clock == CAMWIRE_CLOCK_DC1394)
+        return dma_time;
+    return dma_time + sync.offset + sync.drift*(dma_time - sync.reference);
+}
+
+int camwire::camwire::capture_enqueue(const Camwire_bus_handle_ptr &c_handle, dc1394video_frame_t *frame)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(frame);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+        std::vector<dc1394video_frame_t *>::iterator held =
+            std::find(internal_status->held_frames.begin(), internal_status->held_frames.end(), frame);
+        if (held == internal_status->held_frames.end())
+        {
+            DPRINTF("Frame is not held.");
+            return CAMWIRE_FAILURE;
+        }
+        ERROR_IF_DC1394_FAIL(dc1394_capture_enqueue(c_handle->camera.get(), frame));
+        internal_status->held_frames.erase(held);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to enqueue frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+void camwire::camwire::capture_enqueue_all(const Camwire_bus_handle_ptr &c_handle)
+{
+    try
+    {
+        User_handle internal_status = c_handle->userdata;
+        if (internal_status)
+        {
+            std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+            for (size_t f = 0; f < internal_status->held_frames.size(); ++f)
+                dc1394_capture_enqueue(c_handle->camera.get(), internal_status->held_frames[f]);
+            internal_status->held_frames.clear();
+            internal_status->frame = 0;
+            internal_status->frame_lock = 0;
+        }
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to enqueue held frames");
+    }
+}
+
+int camwire::camwire::capture_dequeue_for(const Camwire_bus_handle_ptr &c_handle, const double timeout, dc1394video_frame_t *&frame)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        frame = 0;
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout > 0.0 ? timeout : 0.0));
+        for (;;)
+        {
+            /* Take a frame that is already waiting without a system call: */
+            ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_POLL, frame));
+            if (frame)
+                return CAMWIRE_SUCCESS;
+
+            int wait_ms = -1;
+            if (timeout >= 0.0)
+            {
+                std::chrono::steady_clock::duration remaining = deadline - std::chrono::steady_clock::now();
+                if (remaining <= std::chrono::steady_clock::duration::zero())
+                    return CAMWIRE_SUCCESS;  /* Timed out.*/
+                /* Round up, so that we never wake just before the frame: */
+                wait_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                              remaining + std::chrono::milliseconds(1) - std::chrono::steady_clock::duration(1)).count());
+            }
+
+            struct pollfd capture_fd;
+            capture_fd.fd = dc1394_capture_get_fileno(c_handle->camera.get());
+            capture_fd.events = POLLIN;
+            capture_fd.revents = 0;
+            if (capture_fd.fd < 0)
+            {
+                DPRINTF("Camera has no capture file descriptor.");
+                return CAMWIRE_FAILURE;
+            }
+            if (poll(&capture_fd, 1, wait_ms) < 0 && errno != EINTR)
+            {
+                DPRINTF("poll() on the capture file descriptor failed.");
+                return CAMWIRE_FAILURE;
+            }
+        }
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to wait for frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+void camwire::camwire::fill_frame(const Camwire_bus_handle_ptr &c_handle, dc1394video_frame_t *dma_frame, Camwire_frame &frame)
+{
+    deliver_frame(c_handle->userdata, dma_frame);
+    frame.owner = this;
+    frame.handle = c_handle;
+    frame.buffer = dma_frame->image;
+    frame.bytes = dma_frame->image_bytes;
+    frame.frame_width = dma_frame->size[0];
+    frame.frame_height = dma_frame->size[1];
+    frame.pixel_coding = convert_colorid2pixelcoding(dma_frame->color_coding);
+    frame.row_stride = dma_frame->stride;
+    if (frame.row_stride == 0 && frame.frame_height > 0)
+        frame.row_stride = frame.bytes/frame.frame_height;
+    frame.number = c_handle->userdata->frame_number;
+    frame.dma_timestamp = convert_dma_timestamp(c_handle->userdata, dma_frame->timestamp*1.0e-6);
+    frame.lag = dma_frame->frames_behind;
+    {
+        std::lock_guard<std::mutex> lock(c_handle->userdata->frame_mutex);
+        frame.generation = c_handle->userdata->capture_generation;
+    }
+    frame.stats.reset();
+    {
+        std::lock_guard<std::mutex> lock(c_handle->userdata->stats_mutex);
+        const std::shared_ptr<const Camwire_image_stats> &latest = c_handle->userdata->image_stats;
+        if (latest && latest->frame_number == frame.number)
+            frame.stats = latest;
+    }
+}
+
+int camwire::camwire::update_geometry(const Camwire_bus_handle_ptr &c_handle, const int width, const int height, const Camwire_pixel coding)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        Camwire_geometry &geometry = internal_status->geometry;
+        ERROR_IF_CAMWIRE_FAIL(pixel_depth(coding, geometry.depth));
+        geometry.width = width;
+        geometry.height = height;
+        geometry.coding = coding;
+        geometry.component_depth = component_depth(coding);
+        geometry.stride = static_cast<size_t>(width)*geometry.depth/8;
+        geometry.frame_bytes = static_cast<size_t>(width)*height*geometry.depth/8;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to update frame geometry");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::component_depth(const Camwire_pixel coding)
+{
+    switch (coding)
+    {
+        case CAMWIRE_PIXEL_MONO8:
+        case CAMWIRE_PIXEL_YUV411:
+        case CAMWIRE_PIXEL_YUV422:
+        case CAMWIRE_PIXEL_YUV444:
+        case CAMWIRE_PIXEL_RGB8:
+        case CAMWIRE_PIXEL_RAW8:
+                                return 8;
+        case CAMWIRE_PIXEL_MONO16:
+        case CAMWIRE_PIXEL_RGB16:
+        case CAMWIRE_PIXEL_MONO16S:
+        case CAMWIRE_PIXEL_RGB16S:
+        case CAMWIRE_PIXEL_RAW16:
+                                return 16;
+        default:
+                                return 0;
+    }
+}
+
+dc1394video_mode_t camwire::camwire::get_1394_video_mode(const Camwire_bus_handle_ptr &c_handle)
+{
+    try
+    {
+       Camwire_conf_ptr config(new Camwire_conf);
+       if(get_config(c_handle, config) != CAMWIRE_SUCCESS)
+           return DC1394_VIDEO_MODE_INVALID;
+       /* FIXME: Need a better way of checking cache initialization than bus_speed: */
+       if (config->bus_speed == 0)
+           return DC1394_VIDEO_MODE_INVALID;
+
+       return convert_format_mode2dc1394video_mode(config->format, config->mode);
+       /* FIXME: Kludge to get it working. Redo video_mode in config. */
+
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get IEEE 1394 image video_mode");
+        return DC1394_VIDEO_MODE_INVALID;
+    }
+}
+
+int camwire::camwire::get_feature_capability(const Camwire_bus_handle_ptr &c_handle, std::shared_ptr<dc1394feature_info_t> &cap, const dc1394feature_t feature)
+{
+    try
+    {
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        #ifdef CAMWIRE_DEBUG
+            if (internal_status->feature_set.feature[feature-DC1394_FEATURE_MIN].id != feature)
+            {
+                DPRINTF("Requested feature does not match feature_set.id.");
+                return 0;
+            }
+        #endif
 
         *cap = internal_status->feature_set.feature[feature - DC1394_FEATURE_MIN];
         return CAMWIRE_SUCCESS;
@@ -2092,7 +2710,7 @@ int camwire::camwire::destroy(const Camwire_bus_handle_ptr &c_handle)
         try
         {
             set_run_stop(c_handle);
-            sleep_frametime(c_handle, 1.5);
+            wait_for_stop(c_handle);
             /* Reset causes problems with too many cameras, so comment it out: */
             dc1394_camera_reset(c_handle->camera.get());
             disconnect_cam(c_handle);
@@ -2123,8 +2741,11 @@ int camwire::camwire::debug_print_status(const Camwire_bus_handle_ptr &c_handle)
         std::cerr << std::endl <<
                      "camera_connected: " << internal_status->camera_connected << std::endl <<
                      "frame_lock: "       << internal_status->frame_lock << std::endl <<
+                     "held_frames: "      << internal_status->held_frames.size() << std::endl <<
                      "frame_number: "     << internal_status->frame_number << std::endl <<
-                     "num_dma_buffers: "  << internal_status->num_dma_buffers << std::endl << std::endl;
+                     "num_dma_buffers: "  << internal_status->num_dma_buffers << std::endl <<
+                     "latest_only: "      << internal_status->latest_only << std::endl <<
+                     "frames_skipped: "   << internal_status->frames_skipped << std::endl << std::endl;
 
         std::cerr << std::endl << "Extras: ";
         Extra_features_ptr extra = internal_status->extras;
@@ -2316,14 +2937,25 @@ int camwire::camwire::flush_framebuffers(const Camwire_bus_handle_ptr &c_handle,
     try
     {
         ERROR_IF_NULL(c_handle);
-        void *buffer; //cannot use shared_ptr here
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        if(internal_status->frame_lock)
+        {
+            DPRINTF("Can't flush before unpointing the current frame.");
+            return CAMWIRE_FAILURE;
+        }
+
+        /* Go straight to the DMA ring, without the per-frame bookkeeping
+           of the pointer access functions: */
+        dc1394video_frame_t *frame;
         int flush_count;
         for(flush_count = 0; flush_count < num_to_flush; ++flush_count)
         {
-            ERROR_IF_CAMWIRE_FAIL(point_next_frame_poll(c_handle, &buffer, buffer_lag));
-            if(!buffer)
+            ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_POLL, frame));
+            if(!frame)
                 break;
-            ERROR_IF_CAMWIRE_FAIL(unpoint_frame(c_handle));
+            buffer_lag = frame->frames_behind;
+            ERROR_IF_CAMWIRE_FAIL(capture_enqueue(c_handle, frame));
         }
 
         if(num_flushed)
@@ -2339,205 +2971,925 @@ int camwire::camwire::flush_framebuffers(const Camwire_bus_handle_ptr &c_handle,
     }
     catch(std::runtime_error &re)
     {
-        DPRINTF("Failed to flush framebuffers");
+        DPRINTF("Failed to flush framebuffers");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::copy_next_frame(const Camwire_bus_handle_ptr &c_handle, void *buffer, int &buffer_lag)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        void *buf_ptr;
+        ERROR_IF_CAMWIRE_FAIL(point_next_frame(c_handle, &buf_ptr, buffer_lag));
+
+        /*  Copy the minimum number of bytes to avoid segfaults if the user's
+            frame buffer is only just big enough to take one frame.  Note
+            that internal_status->frame->total_bytes should not be used
+            because it may include padding that the user has not made
+            provision for: */
+        memcpy(buffer, buf_ptr, internal_status->geometry.frame_bytes);
+        unpoint_frame(c_handle);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to copy next frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::copy_next_frame_native(const Camwire_bus_handle_ptr &c_handle, void *buffer, int &buffer_lag, const int shift)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(buffer);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        const Camwire_geometry &geometry = internal_status->geometry;
+        if (shift < -15 || shift > 15 || (shift != 0 && geometry.component_depth != 16))
+        {
+            DPRINTF("Shift is out of range or the pixel coding is not 16-bit.");
+            return CAMWIRE_FAILURE;
+        }
+
+        void *buf_ptr;
+        ERROR_IF_CAMWIRE_FAIL(point_next_frame(c_handle, &buf_ptr, buffer_lag));
+        if (geometry.component_depth == 16)
+            kernels::be16_to_native(static_cast<const uint8_t *>(buf_ptr),
+                                    static_cast<uint16_t *>(buffer),
+                                    geometry.frame_bytes/2, shift,
+                                    geometry.coding == CAMWIRE_PIXEL_MONO16S ||
+                                    geometry.coding == CAMWIRE_PIXEL_RGB16S);
+        else
+            memcpy(buffer, buf_ptr, geometry.frame_bytes);
+        unpoint_frame(c_handle);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to copy next frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::copy_next_frame_as(const Camwire_bus_handle_ptr &c_handle, void *buffer, const Camwire_output output,
+                                         const size_t dst_stride, int &buffer_lag)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(buffer);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        const Camwire_geometry &geometry = internal_status->geometry;
+        const size_t out_stride = dst_stride ? dst_stride :
+            static_cast<size_t>(geometry.width)*kernels::output_bytes(output);
+        /* An empty row range checks the conversion without touching the
+           buffers, so that no frame is used up if it is not supported: */
+        if (!kernels::convert_rows(0, geometry.stride, geometry.width, geometry.height,
+                                   geometry.coding, geometry.tiling, 0, out_stride, 0, output,
+                                   CAMWIRE_DEMOSAIC_BILINEAR, 0, 0, 0))
+        {
+            DPRINTF("Cannot convert the current pixel coding to this output.");
+            return CAMWIRE_FAILURE;
+        }
+
+        /* The 8- to 16-bit table only changes with the gamma setting: */
+        const int gamma = internal_status->current_set->gamma;
+        if (internal_status->widen_lut_gamma != gamma)
+        {
+            const double widen_max = 65535.0;
+            for (size_t i = 0; i < 256; ++i)
+            {
+                double v = gamma ? widen_max*gamma_inv[i] : 257.0*i;
+                internal_status->widen_lut[i] = htons(static_cast<uint16_t>(v + 0.5));
+            }
+            internal_status->widen_lut_gamma = gamma;
+        }
+
+        dc1394video_frame_t *frame;
+        ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_WAIT, frame));
+        ERROR_IF_NULL(frame);
+        buffer_lag = frame->frames_behind;
+
+        /* Colour correction, statistics and conversion are done together
+           a strip of rows at a time, so that each strip is fetched from
+           memory once, and the frame goes back to the ring as soon as its
+           last strip is converted: */
+        int step, region[4];
+        const int measuring = stats_settings(internal_status, step, region);
+        kernels::Stats_sums sums;
+        const int strip_rows = std::max(2, static_cast<int>(COPY_STRIP_BYTES/std::max<size_t>(geometry.stride, 1)));
+        int converted = 1;
+        for (int row_begin = 0; converted && row_begin < geometry.height; row_begin += strip_rows)
+        {
+            const int row_end = std::min(row_begin + strip_rows, geometry.height);
+            correct_frame_colour(internal_status, frame, row_begin, row_end);
+            if (measuring)
+                kernels::image_stats_rows(frame->image, geometry.stride, geometry.width, geometry.coding,
+                                          geometry.tiling, region[0], region[1], region[2], region[3],
+                                          step, row_begin, row_end, sums);
+            converted = kernels::convert_rows(frame->image, geometry.stride, geometry.width, geometry.height,
+                                              geometry.coding, geometry.tiling, static_cast<uint8_t *>(buffer),
+                                              out_stride, 0, output, CAMWIRE_DEMOSAIC_BILINEAR,
+                                              internal_status->widen_lut, row_begin, row_end);
+        }
+        ERROR_IF_CAMWIRE_FAIL(capture_enqueue(c_handle, frame));
+        ERROR_IF_ZERO(converted);
+
+        Camwire_image_stats stats;
+        if (measuring && kernels::finish_image_stats(sums, stats))
+            publish_stats(internal_status, stats);
+        ++internal_status->frames_delivered;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to copy and convert next frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::point_next_frame(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        if(internal_status->frame_lock)
+        {
+            DPRINTF("Can't point to new frame before unpointing previous frame.");
+            return CAMWIRE_FAILURE;
+        }
+
+        dc1394video_frame_t *frame;
+        ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_WAIT, frame));
+        ERROR_IF_NULL(frame);
+        deliver_frame(internal_status, frame);
+        internal_status->frame = frame;
+        *buf_ptr = (void *)frame->image;
+        internal_status->frame_lock = 1;
+        if(buffer_lag > 0)
+            ERROR_IF_CAMWIRE_FAIL(get_framebuffer_lag(c_handle, buffer_lag));
+
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to copy next frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::point_next_frame_poll(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        if(internal_status->frame_lock)
+        {
+            DPRINTF("Can't point to new frame before unpointing previous frame.");
+            return CAMWIRE_FAILURE;
+        }
+
+        dc1394video_frame_t *frame;
+        ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_POLL, frame));
+        if(!frame)
+        {  /* No frame ready, which is not an error: */
+            *buf_ptr = 0;
+            buffer_lag = 0;
+            return CAMWIRE_SUCCESS;
+        }
+        deliver_frame(internal_status, frame);
+        internal_status->frame = frame;
+        *buf_ptr = (void *)frame->image;
+        internal_status->frame_lock = 1;
+
+        if(buffer_lag > 0)
+            ERROR_IF_CAMWIRE_FAIL(get_framebuffer_lag(c_handle, buffer_lag));
+
+        return CAMWIRE_SUCCESS;
+
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to point next frame poll");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::point_next_frame_for(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag, const double timeout)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        if(internal_status->frame_lock)
+        {
+            DPRINTF("Can't point to new frame before unpointing previous frame.");
+            return CAMWIRE_FAILURE;
+        }
+
+        dc1394video_frame_t *frame;
+        ERROR_IF_CAMWIRE_FAIL(capture_dequeue_for(c_handle, timeout, frame));
+        if(!frame)
+        {  /* Timed out, which is not an error: */
+            *buf_ptr = 0;
+            buffer_lag = 0;
+            return CAMWIRE_SUCCESS;
+        }
+        deliver_frame(internal_status, frame);
+        internal_status->frame = frame;
+        *buf_ptr = (void *)frame->image;
+        internal_status->frame_lock = 1;
+
+        if(buffer_lag > 0)
+            ERROR_IF_CAMWIRE_FAIL(get_framebuffer_lag(c_handle, buffer_lag));
+
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to point next frame with timeout");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::unpoint_frame(const Camwire_bus_handle_ptr &c_handle)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        if(internal_status->frame_lock)
+        {
+            ERROR_IF_CAMWIRE_FAIL(capture_enqueue(c_handle, internal_status->frame));
+            internal_status->frame = 0;
+            internal_status->frame_lock = 0;
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to unpoint frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::hold_next_frame(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        dc1394video_frame_t *frame;
+        ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_WAIT, frame));
+        ERROR_IF_NULL(frame);
+        deliver_frame(c_handle->userdata, frame);
+        *buf_ptr = (void *)frame->image;
+        buffer_lag = frame->frames_behind;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to hold next frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::hold_next_frame_poll(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        dc1394video_frame_t *frame;
+        ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_POLL, frame));
+        if (frame)
+        {
+            deliver_frame(c_handle->userdata, frame);
+            *buf_ptr = (void *)frame->image;
+            buffer_lag = frame->frames_behind;
+        }
+        else
+        {
+            *buf_ptr = 0;
+            buffer_lag = 0;
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to hold next frame poll");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::hold_next_frame_for(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag, const double timeout)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        dc1394video_frame_t *frame;
+        ERROR_IF_CAMWIRE_FAIL(capture_dequeue_for(c_handle, timeout, frame));
+        if (frame)
+        {
+            deliver_frame(c_handle->userdata, frame);
+            *buf_ptr = (void *)frame->image;
+            buffer_lag = frame->frames_behind;
+        }
+        else
+        {
+            *buf_ptr = 0;
+            buffer_lag = 0;
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to hold next frame with timeout");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::dequeue_frame(const Camwire_bus_handle_ptr &c_handle, Camwire_frame &frame, const double timeout)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        ERROR_IF_CAMWIRE_FAIL(frame.release());
+
+        dc1394video_frame_t *dma_frame;
+        ERROR_IF_CAMWIRE_FAIL(capture_dequeue_for(c_handle, timeout, dma_frame));
+        if (!dma_frame)
+            return CAMWIRE_SUCCESS;  /* Timed out.*/
+
+        fill_frame(c_handle, dma_frame, frame);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to dequeue frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::drain_frames(const Camwire_bus_handle_ptr &c_handle, std::vector<Camwire_frame> &frames, int &num_taken)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        frames.clear();
+        frames.reserve(internal_status->num_dma_buffers);
+        num_taken = 0;
+        int num_held;
+        dc1394video_frame_t *dma_frame;
+        for (;;)
+        {
+            ERROR_IF_CAMWIRE_FAIL(get_num_held_frames(c_handle, num_held));
+            if (num_held >= internal_status->num_dma_buffers - 1)
+                break;  /* No room to hold more.*/
+            ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_POLL, dma_frame));
+            if (!dma_frame)
+                break;  /* Ring is empty.*/
+            frames.push_back(Camwire_frame());
+            fill_frame(c_handle, dma_frame, frames.back());
+            ++num_taken;
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to drain frames");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::drain_to_newest(const Camwire_bus_handle_ptr &c_handle, Camwire_frame &newest, int &num_discarded)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        ERROR_IF_CAMWIRE_FAIL(newest.release());
+        num_discarded = 0;
+
+        dc1394video_frame_t *dma_frame;
+        ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_POLL, dma_frame));
+        if (!dma_frame)
+            return CAMWIRE_SUCCESS;
+        /* frames_behind tells us whether a newer frame is waiting, so
+           that each frame can be given back before the next is taken: */
+        while (dma_frame->frames_behind > 0)
+        {
+            ERROR_IF_CAMWIRE_FAIL(capture_enqueue(c_handle, dma_frame));
+            ++num_discarded;
+            ERROR_IF_CAMWIRE_FAIL(capture_dequeue(c_handle, DC1394_CAPTURE_POLICY_POLL, dma_frame));
+            if (!dma_frame)
+            {  /* Should not happen, but the newest frame is gone: */
+                DPRINTF("Frame announced by frames_behind could not be dequeued.");
+                return CAMWIRE_FAILURE;
+            }
+        }
+        fill_frame(c_handle, dma_frame, newest);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to drain to newest frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::release_frame(const Camwire_bus_handle_ptr &c_handle, const void *buf_ptr)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+            generation = internal_status->capture_generation;
+        }
+        return release_frame(c_handle, buf_ptr, generation);
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to release frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::get_frame_generation(const Camwire_bus_handle_ptr &c_handle, const void *buf_ptr, uint64_t &generation)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(buf_ptr);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+        for (size_t f = 0; f < internal_status->held_frames.size(); ++f)
+        {
+            if (internal_status->held_frames[f]->image == buf_ptr)
+            {
+                generation = internal_status->capture_generation;
+                return CAMWIRE_SUCCESS;
+            }
+        }
+        DPRINTF("Buffer is not a held frame.");
+        return CAMWIRE_FAILURE;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get frame generation");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::release_frame(const Camwire_bus_handle_ptr &c_handle, const void *buf_ptr, const uint64_t generation)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(buf_ptr);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        /* One lock throughout, so that the ring cannot be set up again
+           between the checks and the enqueueing: */
+        std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+        if (generation != internal_status->capture_generation)
+        {
+            DPRINTF("Frame is from a DMA ring that has since been set up again.");
+            return CAMWIRE_FAILURE;
+        }
+        std::vector<dc1394video_frame_t *>::iterator held = internal_status->held_frames.begin();
+        while (held != internal_status->held_frames.end() && (*held)->image != buf_ptr)
+            ++held;
+        if (held == internal_status->held_frames.end())
+        {
+            DPRINTF("Buffer is not a held frame.");
+            return CAMWIRE_FAILURE;
+        }
+        if (internal_status->frame_lock && internal_status->frame == *held)
+        {
+            DPRINTF("Buffer was obtained with point_next_frame() and must be "
+                    "given back with unpoint_frame().");
+            return CAMWIRE_FAILURE;
+        }
+        ERROR_IF_DC1394_FAIL(dc1394_capture_enqueue(c_handle->camera.get(), *held));
+        internal_status->held_frames.erase(held);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to release frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::set_latest_only(const Camwire_bus_handle_ptr &c_handle, const int latest_only)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        internal_status->latest_only = (latest_only != 0 ? 1 : 0);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to set latest-only mode");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::get_latest_only(const Camwire_bus_handle_ptr &c_handle, int &latest_only)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        latest_only = internal_status->latest_only;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get latest-only mode");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::get_frames_skipped(const Camwire_bus_handle_ptr &c_handle, int64_t &frames_skipped)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        frames_skipped = internal_status->frames_skipped;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get number of skipped frames");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::set_timestamp_clock(const Camwire_bus_handle_ptr &c_handle, const Camwire_clock clock)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        if (clock != CAMWIRE_CLOCK_DC1394 && clock != CAMWIRE_CLOCK_MONOTONIC && clock != CAMWIRE_CLOCK_REALTIME)
+        {
+            DPRINTF("Invalid time stamp clock.");
+            return CAMWIRE_FAILURE;
+        }
+        /* Start a fresh correlation: */
+        internal_status->clock_sync = Camwire_clock_sync();
+        internal_status->clock_sync.clock = clock;
+        if (clock != CAMWIRE_CLOCK_DC1394)
+            ERROR_IF_CAMWIRE_FAIL(sync_timestamp_clock(c_handle));
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to set time stamp clock");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::get_timestamp_clock(const Camwire_bus_handle_ptr &c_handle, Camwire_clock &clock)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        clock = internal_status->clock_sync.clock;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get time stamp clock");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::get_num_held_frames(const Camwire_bus_handle_ptr &c_handle, int &num_held)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        std::lock_guard<std::mutex> lock(internal_status->frame_mutex);
+        num_held = static_cast<int>(internal_status->held_frames.size());
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get number of held frames");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::inv_gamma(const Camwire_bus_handle_ptr &c_handle, const void *cam_buf, void *lin_buf, const unsigned long max_val)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        /* Checking */
+        if (max_val == 0 || max_val > UINT16_MAX)
+        {
+            DPRINTF("3rd argument is zero or exceeds 16-bit range.");
+            return CAMWIRE_FAILURE;
+        }
+
+        const Camwire_geometry &geometry = internal_status->geometry;
+        if (geometry.component_depth != 8)
+        {
+            DPRINTF("Pixel coding does not have 8-bit components.");
+            return CAMWIRE_FAILURE;
+        }
+
+        /* Initialize look-up table if necessary: */
+        if (static_cast<uint16_t>(max_val) != internal_status->extras->gamma_maxval)
+        {
+            for (size_t i = 0; i < 256; ++i)
+                gamma_lut[i] = htons(static_cast<uint16_t>(max_val*gamma_inv[i] + 0.5));
+
+            internal_status->extras->gamma_maxval = static_cast<uint16_t>(max_val);
+        }
+
+        /* Transform.  With 8-bit components there is one component per
+           frame byte: */
+        kernels::lookup_8to16(reinterpret_cast<const uint8_t *>(cam_buf),
+                              reinterpret_cast<uint16_t *>(lin_buf),
+                              geometry.frame_bytes,
+                              gamma_lut);
+
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to transform buffers using inv_gamma");
         return CAMWIRE_FAILURE;
     }
 }
 
-int camwire::camwire::copy_next_frame(const Camwire_bus_handle_ptr &c_handle, void *buffer, int &buffer_lag)
+int camwire::camwire::native_byte_order(const Camwire_bus_handle_ptr &c_handle, void *buffer, const int shift)
 {
     try
     {
         ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(buffer);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
 
-        void *buf_ptr;
-        ERROR_IF_CAMWIRE_FAIL(point_next_frame(c_handle, &buf_ptr, buffer_lag));
-
-        /*  Copy the minimum number of bytes to avoid segfaults if the user's
-            frame buffer is only just big enough to take one frame.  Note
-            that internal_status->frame->total_bytes should not be used
-            because it may include padding that the user has not made
-            provision for: */
-        int width, height, depth;
-        Camwire_pixel coding;
+        const Camwire_geometry &geometry = internal_status->geometry;
+        if (geometry.component_depth != 16)
+        {
+            DPRINTF("Pixel coding does not have 16-bit components.");
+            return CAMWIRE_FAILURE;
+        }
+        if (shift < -15 || shift > 15)
+        {
+            DPRINTF("Shift is out of range.");
+            return CAMWIRE_FAILURE;
+        }
 
-        ERROR_IF_CAMWIRE_FAIL(get_frame_size(c_handle, width, height));
-        ERROR_IF_CAMWIRE_FAIL(get_pixel_coding(c_handle, coding));
-        ERROR_IF_CAMWIRE_FAIL(pixel_depth(coding, depth));
-        memcpy(buffer, buf_ptr, (size_t) width*height*depth/8);
-        unpoint_frame(c_handle);
+        kernels::be16_to_native(static_cast<const uint8_t *>(buffer),
+                                static_cast<uint16_t *>(buffer),
+                                geometry.frame_bytes/2, shift,
+                                geometry.coding == CAMWIRE_PIXEL_MONO16S ||
+                                geometry.coding == CAMWIRE_PIXEL_RGB16S);
         return CAMWIRE_SUCCESS;
     }
     catch(std::runtime_error &re)
     {
-        DPRINTF("Failed to copy next frame");
+        DPRINTF("Failed to convert buffer to native byte order");
         return CAMWIRE_FAILURE;
     }
 }
 
-int camwire::camwire::point_next_frame(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag)
+int camwire::camwire::demosaic(const Camwire_bus_handle_ptr &c_handle, const void *raw_buf, void *rgb_buf,
+                               const Camwire_output output, const Camwire_demosaic method,
+                               const size_t dst_stride, const int num_threads)
 {
     try
     {
         ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(raw_buf);
+        ERROR_IF_NULL(rgb_buf);
         User_handle internal_status = c_handle->userdata;
         ERROR_IF_NULL(internal_status);
-        if(internal_status->frame_lock)
+
+        const Camwire_geometry &geometry = internal_status->geometry;
+        int src_bytes;
+        switch (geometry.coding)
         {
-            DPRINTF("Can't point to new frame before unpointing previous frame.");
+            case CAMWIRE_PIXEL_MONO8:
+            case CAMWIRE_PIXEL_RAW8:
+                src_bytes = 1;
+                break;
+            case CAMWIRE_PIXEL_MONO16:
+            case CAMWIRE_PIXEL_RAW16:
+                src_bytes = 2;
+                break;
+            default:
+                DPRINTF("Pixel coding is not a raw Bayer coding.");
+                return CAMWIRE_FAILURE;
+        }
+        if (output != CAMWIRE_OUTPUT_RGB8 && output != CAMWIRE_OUTPUT_BGR8 &&
+            output != CAMWIRE_OUTPUT_RGB16)
+        {
+            DPRINTF("Output layout must be RGB8, BGR8 or RGB16.");
             return CAMWIRE_FAILURE;
         }
-
-        int dc1394_return = dc1394_capture_dequeue(c_handle->camera.get(), DC1394_CAPTURE_POLICY_WAIT, &internal_status->frame);
-        if(dc1394_return != DC1394_SUCCESS)
+        if (geometry.tiling == CAMWIRE_TILING_INVALID ||
+            geometry.tiling == CAMWIRE_TILING_UYVY || geometry.tiling == CAMWIRE_TILING_YUYV)
         {
-            internal_status->frame = 0;
-            DPRINTF("dc1394_capture_dequeue() failed");
+            DPRINTF("Camera does not report a Bayer tiling.");
             return CAMWIRE_FAILURE;
         }
 
-        ERROR_IF_NULL(internal_status->frame);
-        *buf_ptr = (void *)internal_status->frame->image;
-        internal_status->frame_lock = 1;
-        /*  Record buffer timestamp for later use by camwire_get_timestamp(),
-            because we don't want to assume that dc1394_capture_enqueue()
-            does not mess with its frame arg:*/
-        internal_status->dma_timestamp = internal_status->frame->timestamp*1.0e-6;
-        /* Increment the frame number if we have a frame: */
-        ++internal_status->frame_number;
-        if(buffer_lag > 0)
-            ERROR_IF_CAMWIRE_FAIL(get_framebuffer_lag(c_handle, buffer_lag));
+        const int width = geometry.width, height = geometry.height;
+        if (width < 1 || height < 1)
+        {
+            DPRINTF("Image size is not known.");
+            return CAMWIRE_FAILURE;
+        }
+        const size_t out_stride = dst_stride ? dst_stride :
+            static_cast<size_t>(width)*kernels::output_bytes(output);
+        const uint8_t *src = static_cast<const uint8_t *>(raw_buf);
+        uint8_t *dst = static_cast<uint8_t *>(rgb_buf);
+
+        /* Bands start on even rows so that each begins on the same tile
+           row.  They run on the handle's worker threads, which are kept
+           between frames: */
+        const int pool_size = std::max(1, num_threads);
+        int num_bands = std::max(1, std::min(pool_size, height/2));
+        const int band_rows = ((height + num_bands - 1)/num_bands + 1) & ~1;
+        num_bands = (height + band_rows - 1)/band_rows;
+        std::vector<int> results(num_bands, 0);
+        std::lock_guard<std::mutex> lock(internal_status->pool_mutex);
+        if (!internal_status->pool || internal_status->pool->size() != pool_size)
+        {
+            internal_status->pool.reset();
+            internal_status->pool.reset(new camwirethreadpool(pool_size));
+        }
+        internal_status->pool->parallel_for(num_bands, [&](const int b, const int) {
+            const int row_begin = b*band_rows;
+            const int row_end = std::min(row_begin + band_rows, height);
+            try
+            {
+                results[b] = kernels::demosaic_rows(src, geometry.stride, width, height, src_bytes,
+                                                    geometry.tiling, dst, out_stride, output,
+                                                    method, row_begin, row_end);
+            }
+            catch(std::bad_alloc &ba)
+            {
+                results[b] = 0;  /* Must not escape a worker thread.*/
+            }
+        });
 
+        if (std::find(results.begin(), results.end(), 0) != results.end())
+        {
+            DPRINTF("kernels::demosaic_rows() failed.");
+            return CAMWIRE_FAILURE;
+        }
         return CAMWIRE_SUCCESS;
     }
     catch(std::runtime_error &re)
     {
-        DPRINTF("Failed to copy next frame");
+        DPRINTF("Failed to demosaic image");
         return CAMWIRE_FAILURE;
     }
 }
 
-/* DRY at its finest: with a flag, it will be possible to unify point_next_frame with this function */
-int camwire::camwire::point_next_frame_poll(const Camwire_bus_handle_ptr &c_handle, void **buf_ptr, int &buffer_lag)
+int camwire::camwire::convert_yuv(const Camwire_bus_handle_ptr &c_handle, const void *yuv_buf, void *out_buf,
+                                  const Camwire_output output, const Camwire_yuv_matrix matrix,
+                                  const size_t dst_stride)
 {
     try
     {
         ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(yuv_buf);
+        ERROR_IF_NULL(out_buf);
         User_handle internal_status = c_handle->userdata;
         ERROR_IF_NULL(internal_status);
 
-        if(internal_status->frame_lock)
+        const Camwire_geometry &geometry = internal_status->geometry;
+        if (geometry.coding != CAMWIRE_PIXEL_YUV411 && geometry.coding != CAMWIRE_PIXEL_YUV422 &&
+            geometry.coding != CAMWIRE_PIXEL_YUV444)
         {
-            DPRINTF("Can't point to new frame before unpointing previous frame.");
+            DPRINTF("Pixel coding is not a YUV coding.");
             return CAMWIRE_FAILURE;
         }
-        int dc1394_return = dc1394_capture_dequeue(c_handle->camera.get(), DC1394_CAPTURE_POLICY_POLL, &internal_status->frame);
-        if(dc1394_return != DC1394_SUCCESS)
+        if (output != CAMWIRE_OUTPUT_GRAY8 && output != CAMWIRE_OUTPUT_RGB8 &&
+            output != CAMWIRE_OUTPUT_BGR8)
         {
-            internal_status->frame = 0;
-            DPRINTF("dc1394_capture_dequeue() failed");
+            DPRINTF("Output layout must be GRAY8, RGB8 or BGR8.");
             return CAMWIRE_FAILURE;
         }
 
-        ERROR_IF_NULL(internal_status->frame);
-        *buf_ptr = (void *)internal_status->frame->image;
-        internal_status->frame_lock = 1;
-
-        /*  Record buffer timestamp for later use by camwire_get_timestamp(),
-            because we don't want to assume that dc1394_capture_enqueue()
-            does not mess with its frame arg:*/
-        internal_status->dma_timestamp = internal_status->frame->timestamp*1.0e-6;
-
-        /* Increment the frame number if we have a frame: */
-        ++internal_status->frame_number;
-
-        if(buffer_lag > 0)
-            ERROR_IF_CAMWIRE_FAIL(get_framebuffer_lag(c_handle, buffer_lag));
-
+        const size_t out_stride = dst_stride ? dst_stride :
+            static_cast<size_t>(geometry.width)*kernels::output_bytes(output);
+        ERROR_IF_ZERO(kernels::yuv_to_rgb_rows(static_cast<const uint8_t *>(yuv_buf), geometry.stride,
+                                               geometry.width, geometry.coding, geometry.tiling,
+                                               static_cast<uint8_t *>(out_buf), out_stride, output,
+                                               matrix, 0, geometry.height));
         return CAMWIRE_SUCCESS;
-
     }
     catch(std::runtime_error &re)
     {
-        DPRINTF("Failed to point next frame poll");
+        DPRINTF("Failed to convert YUV image");
         return CAMWIRE_FAILURE;
     }
 }
 
-int camwire::camwire::unpoint_frame(const Camwire_bus_handle_ptr &c_handle)
+int camwire::camwire::get_reduced_frame_size(const Camwire_bus_handle_ptr &c_handle, const int factor,
+                                             int &width, int &height)
 {
     try
     {
         ERROR_IF_NULL(c_handle);
-        User_handle internal_status(new Camwire_user_data);
-        internal_status = c_handle->userdata;
+        User_handle internal_status = c_handle->userdata;
         ERROR_IF_NULL(internal_status);
 
-        if(internal_status->frame_lock)
+        const Camwire_geometry &geometry = internal_status->geometry;
+        if (!kernels::reduced_size(geometry.width, geometry.height, geometry.coding, geometry.tiling,
+                                   factor, width, height))
         {
-            ERROR_IF_DC1394_FAIL(dc1394_capture_enqueue(c_handle->camera.get(), internal_status->frame));
-            internal_status->frame = 0;
-            internal_status->frame_lock = 0;
+            DPRINTF("Pixel coding or reduction factor is not supported.");
+            return CAMWIRE_FAILURE;
         }
         return CAMWIRE_SUCCESS;
     }
     catch(std::runtime_error &re)
     {
-        DPRINTF("Failed to unpoint frame");
+        DPRINTF("Failed to get reduced frame size");
         return CAMWIRE_FAILURE;
     }
 }
 
-int camwire::camwire::inv_gamma(const Camwire_bus_handle_ptr &c_handle, const void *cam_buf, void *lin_buf, const unsigned long max_val)
+int camwire::camwire::reduce_frame(const Camwire_bus_handle_ptr &c_handle, const void *src, void *dst,
+                                   const int factor, const Camwire_reduction method,
+                                   const size_t dst_stride)
 {
     try
     {
-        ERROR_IF_NULL(c_handle);
-        User_handle internal_status = c_handle->userdata;
-        ERROR_IF_NULL(internal_status);
-
-        /* Checking */
-        if (max_val == 0 || max_val > UINT16_MAX)
-        {
-            DPRINTF("3rd argument is zero or exceeds 16-bit range.");
-            return CAMWIRE_FAILURE;
-        }
+        int width, height;
 
-        Camwire_pixel coding;
-        ERROR_IF_CAMWIRE_FAIL(get_pixel_coding(c_handle, coding));
-        if (component_depth(coding) != 8)
-        {
-            DPRINTF("Pixel coding does not have 8-bit components.");
-            return CAMWIRE_FAILURE;
-        }
-
-        /* Initialize look-up table if necessary: */
-        if (static_cast<uint16_t>(max_val) != internal_status->extras->gamma_maxval)
-        {
-            for (size_t i = 0; i < 256; ++i)
-                gamma_lut[i] = htons(static_cast<uint16_t>(max_val*gamma_inv[i] + 0.5));
-
-            internal_status->extras->gamma_maxval = static_cast<uint16_t>(max_val);
-        }
-
-        int width, height, depth;
-        uint16_t *endp, *outp;
-        size_t num_components;
-        /* Transform: */
-        ERROR_IF_CAMWIRE_FAIL(get_frame_size(c_handle, width, height));
-        ERROR_IF_CAMWIRE_FAIL(pixel_depth(coding, depth));
-        num_components = static_cast<size_t>(width*height*depth/8);
-
-        const uint8_t *inp = reinterpret_cast<const uint8_t *>(cam_buf);
-        endp = reinterpret_cast<uint16_t *>(lin_buf) + num_components;
-        for (outp = reinterpret_cast<uint16_t *>(lin_buf); outp != endp; ++outp)
-            *outp = gamma_lut[*inp++];
+        ERROR_IF_NULL(src);
+        ERROR_IF_NULL(dst);
+        ERROR_IF_CAMWIRE_FAIL(get_reduced_frame_size(c_handle, factor, width, height));
+        const Camwire_geometry &geometry = c_handle->userdata->geometry;
 
+        const size_t out_stride = dst_stride ? dst_stride :
+            static_cast<size_t>(width)*geometry.depth/8;
+        ERROR_IF_ZERO(kernels::reduce_rows(static_cast<const uint8_t *>(src), geometry.stride,
+                                           geometry.width, geometry.height, geometry.coding,
+                                           geometry.tiling, factor, method,
+                                           static_cast<uint8_t *>(dst), out_stride, 0, height));
         return CAMWIRE_SUCCESS;
     }
     catch(std::runtime_error &re)
     {
-        DPRINTF("Failed to transform buffers using inv_gamma");
+        DPRINTF("Failed to reduce frame");
         return CAMWIRE_FAILURE;
     }
 }
@@ -2652,6 +4004,9 @@ int camwire::camwire::set_run_stop(const Camwire_bus_handle_ptr &c_handle, const
                 }
             }
         }
+        /* The time between a stop and a start is not a gap between
+           frames: */
+        internal_status->stats_timestamp = 0.0;
         shadow_state->running = runsts;
         return CAMWIRE_SUCCESS;
     }
@@ -2965,10 +4320,10 @@ int camwire::camwire::set_colour_correction(const Camwire_bus_handle_ptr &c_hand
         ERROR_IF_CAMWIRE_FAIL(get_shadow_state(c_handle, shadow_state));
         if (!internal_status->extras->colour_corr_capable)
         {
-            /* Colour correction is always switched off if the camera can't do it: */
-            shadow_state->colour_corr = 0;
-            DPRINTF("Camera reported no colour correction capability.");
-            return CAMWIRE_FAILURE;
+            /* Done on the host, with the coefficients in the shadow state,
+               as frames are handed out: */
+            shadow_state->colour_corr = (corr_on ? 1 : 0);
+            return CAMWIRE_SUCCESS;
         }
 
         double coef[9];
@@ -3008,9 +4363,22 @@ int camwire::camwire::set_colour_coefficients(const Camwire_bus_handle_ptr &c_ha
         ERROR_IF_CAMWIRE_FAIL(get_shadow_state(c_handle, shadow_state));
         if (!internal_status->extras->colour_corr_capable)
         {
-            /* Colour coefficient matrix is fixed if the camera can't set it: */
-            DPRINTF("Camera reported no capability to change colour coefficients.");
-            return CAMWIRE_FAILURE;
+            /* Colour correction is done on the host, in Q10 fixed point.
+               The limit keeps 16-bit sums within 32 bits: */
+            for (int c = 0; c < 9; ++c)
+            {
+                if (coef[c] < -8.0 || coef[c] > 8.0)
+                {
+                    DPRINTF("Colour coefficient out of range.");
+                    return CAMWIRE_FAILURE;
+                }
+            }
+            for (int c = 0; c < 9; ++c)
+            {
+                shadow_state->colour_coef[c] = coef[c];
+                internal_status->host_colour_coef[c] = static_cast<int32_t>(lround(coef[c]*1024.0));
+            }
+            return CAMWIRE_SUCCESS;
         }
 
         int32_t val[9];
@@ -3184,128 +4552,339 @@ int camwire::camwire::set_num_framebuffers(const Camwire_bus_handle_ptr &c_handl
     }
     catch(std::runtime_error &re)
     {
-        DPRINTF("Failed to set num framebuffers");
+        DPRINTF("Failed to set num framebuffers");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::set_frame_size(const Camwire_bus_handle_ptr &c_handle, const int width, const int height)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        dc1394video_mode_t video_mode;
+        video_mode = get_1394_video_mode(c_handle);
+        ERROR_IF_ZERO(video_mode);
+
+        int left, top;
+        int new_width, new_height;
+        Camwire_state_ptr settings(new Camwire_state);
+        Camwire_conf_ptr config(new Camwire_conf);
+        if (fixed_image_size(video_mode))  /* Format 0, 1 or 2.*/
+        {
+            DPRINTF("Attempt to change frame size in a fixed image size format.");
+            return CAMWIRE_FAILURE;
+        }
+        else if (variable_image_size(video_mode))  /* Format 7.*/
+        {
+            ERROR_IF_CAMWIRE_FAIL(get_current_settings(c_handle, settings));
+            /* Width and height: */
+            if (width == settings->width && height == settings->height)
+            {
+                return CAMWIRE_SUCCESS; 	/* Nothing has changed.*/
+            }
+            ERROR_IF_CAMWIRE_FAIL(get_frame_offset(c_handle, left, top));
+            new_width = width;
+            new_height = height;
+            ERROR_IF_CAMWIRE_FAIL(fit_frame_size(c_handle, left, top, new_width, new_height));
+
+                /* Only proceed if size has changed after all: */
+            if (new_width != settings->width || new_height != settings->height)
+            {
+                settings->width  = new_width;
+                settings->height = new_height;
+
+                /* Set the new dimensions by re-initializing the camera: */
+                ERROR_IF_CAMWIRE_FAIL(get_config(c_handle, config));
+                ERROR_IF_CAMWIRE_FAIL(
+                reconnect_cam(c_handle, config, settings));
+            }
+        }
+        else
+        {
+            DPRINTF("Unsupported camera format.");
+            return CAMWIRE_FAILURE;
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to set frame size");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::set_frame_offset(const Camwire_bus_handle_ptr &c_handle, const int left, const int top)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        dc1394video_mode_t video_mode;
+        video_mode = get_1394_video_mode(c_handle);
+        ERROR_IF_ZERO(video_mode);
+        if (!variable_image_size(video_mode))
+        {
+            DPRINTF("Attempt to change frame offset in a fixed image size format.");
+            return CAMWIRE_FAILURE;
+        }
+
+        uint32_t max_width, max_height;
+        uint32_t hor_unit, ver_unit;
+        int width, height, old_left, old_top;
+        ERROR_IF_DC1394_FAIL(dc1394_format7_get_max_image_size(c_handle->camera.get(),
+            video_mode,
+            &max_width,
+            &max_height));
+        ERROR_IF_DC1394_FAIL(dc1394_format7_get_unit_position(c_handle->camera.get(),
+            video_mode,
+            &hor_unit,
+            &ver_unit));
+        if (hor_unit == 0 || ver_unit == 0)
+        {
+            DPRINTF("dc1394_format7_get_unit_position() returned a zero "
+                "unit position.");
+            return CAMWIRE_FAILURE;
+        }
+        ERROR_IF_CAMWIRE_FAIL(get_frame_size(c_handle, width, height));
+        ERROR_IF_CAMWIRE_FAIL(get_frame_offset(c_handle, old_left, old_top));
+
+        /* Round to the position units and keep the frame on the sensor: */
+        int hor_limit = (static_cast<int>(max_width) - width)/static_cast<int>(hor_unit);
+        int ver_limit = (static_cast<int>(max_height) - height)/static_cast<int>(ver_unit);
+        int new_left = (std::max(left, 0) + hor_unit/2)/hor_unit;
+        int new_top = (std::max(top, 0) + ver_unit/2)/ver_unit;
+        if (new_left > hor_limit)  new_left = hor_limit;
+        if (new_top > ver_limit)   new_top = ver_limit;
+        if (new_left < 0 || new_top < 0)
+        {
+            DPRINTF("Frame is larger than the sensor.");
+            return CAMWIRE_FAILURE;
+        }
+        new_left *= hor_unit;
+        new_top *= ver_unit;
+        if (new_left == old_left && new_top == old_top)
+            return CAMWIRE_SUCCESS;  /* Nothing has changed.*/
+
+        /* The frame size and so the packet layout stay the same, so the
+           DMA buffers are still good.  Cameras which do not take a new
+           position while transmitting get a short pause instead of a
+           reconnect: */
+        if (dc1394_format7_set_image_position(c_handle->camera.get(), video_mode,
+                                              new_left, new_top) != DC1394_SUCCESS)
+        {
+            int running;
+            ERROR_IF_CAMWIRE_FAIL(get_run_stop(c_handle, running));
+            if (!running)
+            {
+                DPRINTF("dc1394_format7_set_image_position() failed.");
+                return CAMWIRE_FAILURE;
+            }
+            ERROR_IF_CAMWIRE_FAIL(set_run_stop(c_handle, 0));
+            dc1394error_t written = dc1394_format7_set_image_position(c_handle->camera.get(), video_mode,
+                                                                      new_left, new_top);
+            /* Leave the camera running at the old offset either way: */
+            ERROR_IF_CAMWIRE_FAIL(set_run_stop(c_handle, 1));
+            if (written != DC1394_SUCCESS)
+            {
+                DPRINTF("dc1394_format7_set_image_position() failed with the camera stopped.");
+                return CAMWIRE_FAILURE;
+            }
+        }
+
+        Camwire_state_ptr shadow_state;
+        ERROR_IF_CAMWIRE_FAIL(get_shadow_state(c_handle, shadow_state));
+        ERROR_IF_NULL(shadow_state);
+        shadow_state->left = new_left;
+        shadow_state->top = new_top;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to set frame offset");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::set_framerate(const Camwire_bus_handle_ptr &c_handle, const double frame_rate)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        ERROR_IF_NULL(internal_status->current_set);
+        if (frame_rate <= 0.0)
+        {
+            DPRINTF("Frame rate must be positive.");
+            return CAMWIRE_FAILURE;
+        }
+        dc1394video_mode_t video_mode;
+        video_mode = get_1394_video_mode(c_handle);
+        ERROR_IF_ZERO(video_mode);
+
+        int was_running;
+        double old_frame_rate, actual_frame_rate;
+        dc1394error_t written;
+        if (fixed_image_size(video_mode))  /* Format 0, 1 or 2.*/
+        {
+            dc1394framerates_t framerate_list;
+            dc1394framerate_t old_index, new_index;
+            ERROR_IF_DC1394_FAIL(dc1394_video_get_supported_framerates(c_handle->camera.get(), video_mode, &framerate_list));
+            if (framerate_list.num == 0)
+            {
+                DPRINTF("dc1394_video_get_supported_framerates returned an empty list");
+                return CAMWIRE_FAILURE;
+            }
+            new_index = static_cast<dc1394framerate_t>(convert_framerate2index(frame_rate, framerate_list));
+            ERROR_IF_ZERO(new_index);
+            ERROR_IF_DC1394_FAIL(dc1394_video_get_framerate(c_handle->camera.get(), &old_index));
+            old_frame_rate = convert_index2framerate(old_index);
+            actual_frame_rate = convert_index2framerate(new_index);
+            if (new_index == old_index)
+            {
+                internal_status->current_set->frame_rate = actual_frame_rate;
+                return CAMWIRE_SUCCESS;  /* Nothing has changed.*/
+            }
+
+            ERROR_IF_CAMWIRE_FAIL(pause_capture(c_handle, was_running));
+            written = dc1394_video_set_framerate(c_handle->camera.get(), new_index);
+        }
+        else if (variable_image_size(video_mode))  /* Format 7.*/
+        {
+            const Camwire_geometry &geometry = internal_status->geometry;
+            uint32_t num_packets, old_packet_size, new_packet_size;
+            num_packets = convert_framerate2numpackets(c_handle, frame_rate);
+            ERROR_IF_ZERO(num_packets);
+            new_packet_size = convert_numpackets2packetsize(c_handle, num_packets, geometry.width,
+                                                            geometry.height, geometry.coding);
+            ERROR_IF_ZERO(new_packet_size);
+            num_packets = convert_packetsize2numpackets(c_handle, new_packet_size, geometry.width,
+                                                        geometry.height, geometry.coding);
+            ERROR_IF_ZERO(num_packets);
+            actual_frame_rate = convert_numpackets2framerate(c_handle, num_packets);
+            ERROR_IF_DC1394_FAIL(dc1394_format7_get_packet_size(c_handle->camera.get(), video_mode, &old_packet_size));
+            if (new_packet_size == old_packet_size)
+            {
+                internal_status->current_set->frame_rate = actual_frame_rate;
+                return CAMWIRE_SUCCESS;  /* Nothing has changed.*/
+            }
+
+            /* The image format stays, but libdc1394 lays out its DMA
+               buffers by packet, so they must be set up again: */
+            num_packets = convert_packetsize2numpackets(c_handle, old_packet_size, geometry.width,
+                                                        geometry.height, geometry.coding);
+            old_frame_rate = (num_packets > 0 ? convert_numpackets2framerate(c_handle, num_packets) :
+                              internal_status->current_set->frame_rate);
+            ERROR_IF_CAMWIRE_FAIL(pause_capture(c_handle, was_running));
+            written = dc1394_format7_set_packet_size(c_handle->camera.get(), video_mode, new_packet_size);
+        }
+        else
+        {
+            DPRINTF("Unsupported camera format.");
+            return CAMWIRE_FAILURE;
+        }
+        if (written != DC1394_SUCCESS)
+        {  /* Carry on at the old rate rather than leave the capture torn
+              down and the camera stopped: */
+            DPRINTF("Could not write the new frame rate to the camera.");
+            resume_capture(c_handle, was_running, old_frame_rate);
+            return CAMWIRE_FAILURE;
+        }
+        ERROR_IF_CAMWIRE_FAIL(resume_capture(c_handle, was_running, actual_frame_rate));
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to set framerate");
         return CAMWIRE_FAILURE;
     }
 }
 
-int camwire::camwire::set_frame_size(const Camwire_bus_handle_ptr &c_handle, const int width, const int height)
+int camwire::camwire::fit_frame_size(const Camwire_bus_handle_ptr &c_handle, const int left, const int top,
+                                     int &width, int &height)
 {
     try
     {
-        ERROR_IF_NULL(c_handle);
         dc1394video_mode_t video_mode;
         video_mode = get_1394_video_mode(c_handle);
         ERROR_IF_ZERO(video_mode);
 
         uint32_t max_width, max_height;
         uint32_t hor_pixel_unit, ver_pixel_unit;
-        int left, top;
         int hor_limit, ver_limit;
         int new_width, new_height;
         int min_pixel_units;
-        Camwire_state_ptr settings(new Camwire_state);
         Camwire_conf_ptr config(new Camwire_conf);
-        if (fixed_image_size(video_mode))  /* Format 0, 1 or 2.*/
+
+        /* Get maximum width, maximum height and unit pixel sizes from the
+           camera: */
+        ERROR_IF_DC1394_FAIL(dc1394_format7_get_max_image_size(c_handle->camera.get(),
+            video_mode,
+            &max_width,
+            &max_height));
+
+        if (max_width  == 0 || max_height == 0)
         {
-            DPRINTF("Attempt to change frame size in a fixed image size format.");
+            DPRINTF("dc1394_format7_get_max_image_size() returned a zero "
+                "maximum size.");
+            return CAMWIRE_FAILURE;
+        }
+        ERROR_IF_DC1394_FAIL(
+           dc1394_format7_get_unit_size(
+            c_handle->camera.get(),
+            video_mode,
+            &hor_pixel_unit,
+            &ver_pixel_unit));
+        if (hor_pixel_unit == 0 || ver_pixel_unit == 0)
+        {
+            DPRINTF("dc1394_format7_get_unit_size() returned a zero "
+                "unit size.");
             return CAMWIRE_FAILURE;
         }
-        else if (variable_image_size(video_mode))  /* Format 7.*/
-        {
-            ERROR_IF_CAMWIRE_FAIL(get_current_settings(c_handle, settings));
-            /* Width and height: */
-            if (width == settings->width && height == settings->height)
-            {
-                return CAMWIRE_SUCCESS; 	/* Nothing has changed.*/
-            }
-            /* Get maximum width, maximum height, unit pixel sizes, and
-               offsets from the camera: */
-            ERROR_IF_DC1394_FAIL(dc1394_format7_get_max_image_size(c_handle->camera.get(),
-                video_mode,
-                &max_width,
-                &max_height));
-
-            if (max_width  == 0 || max_height == 0)
-            {
-                DPRINTF("dc1394_format7_get_max_image_size() returned a zero "
-                    "maximum size.");
-                return CAMWIRE_FAILURE;
-            }
-            ERROR_IF_DC1394_FAIL(
-               dc1394_format7_get_unit_size(
-                c_handle->camera.get(),
-                video_mode,
-                &hor_pixel_unit,
-                &ver_pixel_unit));
-            if (hor_pixel_unit == 0 || ver_pixel_unit == 0)
-            {
-                DPRINTF("dc1394_format7_get_unit_size() returned a zero "
-                    "unit size.");
-                return CAMWIRE_FAILURE;
-            }
-
-            ERROR_IF_CAMWIRE_FAIL(get_frame_offset(c_handle, left, top));
-            /* Adjust input arguments if necessary, taking maximum frame
-               sizes, current offsets and unit pixel sizes into account: */
-            if (width < INT_MAX - static_cast<int>(hor_pixel_unit)/2)
-                new_width  = (width  + hor_pixel_unit/2)/hor_pixel_unit;
-            else
-                new_width = INT_MAX/hor_pixel_unit;
 
-            if (height < INT_MAX - static_cast<int>(ver_pixel_unit)/2)
-                new_height = (height + ver_pixel_unit/2)/ver_pixel_unit;
-            else
-                new_height = INT_MAX/ver_pixel_unit;
+        /* Adjust input arguments if necessary, taking maximum frame
+           sizes, offsets and unit pixel sizes into account: */
+        if (width < INT_MAX - static_cast<int>(hor_pixel_unit)/2)
+            new_width  = (width  + hor_pixel_unit/2)/hor_pixel_unit;
+        else
+            new_width = INT_MAX/hor_pixel_unit;
 
-            if (new_width  < 1)
-                new_width = 1;
-            if (new_height < 1)
-                new_height = 1;
+        if (height < INT_MAX - static_cast<int>(ver_pixel_unit)/2)
+            new_height = (height + ver_pixel_unit/2)/ver_pixel_unit;
+        else
+            new_height = INT_MAX/ver_pixel_unit;
 
-            hor_limit = (max_width - left)/hor_pixel_unit;
-            ver_limit = (max_height - top)/ver_pixel_unit;
-            if (new_width  > hor_limit)  new_width  = hor_limit;
-            if (new_height > ver_limit)  new_height = ver_limit;
+        if (new_width  < 1)
+            new_width = 1;
+        if (new_height < 1)
+            new_height = 1;
 
-            /* Maintain the minimum number of pixels: */
-            ERROR_IF_CAMWIRE_FAIL(get_config(c_handle, config));
-            min_pixel_units = config->min_pixels/(hor_pixel_unit*ver_pixel_unit);
-            if (new_width*new_height < min_pixel_units)
-            {
-                new_width = (min_pixel_units + new_height - 1)/new_height;
-                if (new_width > hor_limit)
-                {
-                    new_width = hor_limit;
-                    new_height = (min_pixel_units + new_width - 1)/new_width;
-                    if (new_height > ver_limit)
-                        new_height = ver_limit;
-                }
-            }
-            new_width  *= hor_pixel_unit;
-            new_height *= ver_pixel_unit;
+        hor_limit = (max_width - left)/hor_pixel_unit;
+        ver_limit = (max_height - top)/ver_pixel_unit;
+        if (new_width  > hor_limit)  new_width  = hor_limit;
+        if (new_height > ver_limit)  new_height = ver_limit;
 
-                /* Only proceed if size has changed after all: */
-            if (new_width != settings->width || new_height != settings->height)
+        /* Maintain the minimum number of pixels: */
+        ERROR_IF_CAMWIRE_FAIL(get_config(c_handle, config));
+        min_pixel_units = config->min_pixels/(hor_pixel_unit*ver_pixel_unit);
+        if (new_width*new_height < min_pixel_units)
+        {
+            new_width = (min_pixel_units + new_height - 1)/new_height;
+            if (new_width > hor_limit)
             {
-                settings->width  = new_width;
-                settings->height = new_height;
-
-                /* Set the new dimensions by re-initializing the camera: */
-                ERROR_IF_CAMWIRE_FAIL(
-                reconnect_cam(c_handle, config, settings));
+                new_width = hor_limit;
+                new_height = (min_pixel_units + new_width - 1)/new_width;
+                if (new_height > ver_limit)
+                    new_height = ver_limit;
             }
         }
-        else
-        {
-            DPRINTF("Unsupported camera format.");
-            return CAMWIRE_FAILURE;
-        }
+        width  = new_width*hor_pixel_unit;
+        height = new_height*ver_pixel_unit;
         return CAMWIRE_SUCCESS;
     }
     catch(std::runtime_error &re)
     {
-        DPRINTF("Failed to set frame size");
+        DPRINTF("Failed to fit frame size");
         return CAMWIRE_FAILURE;
     }
 }
@@ -3374,6 +4953,10 @@ int camwire::camwire::set_pixel_coding(const Camwire_bus_handle_ptr &c_handle, c
                     ERROR_IF_CAMWIRE_FAIL(get_shadow_state(c_handle, shadow_state));
                     ERROR_IF_NULL(shadow_state);
                     shadow_state->coding = coding;
+                    ERROR_IF_CAMWIRE_FAIL(update_geometry(c_handle,
+                        c_handle->userdata->geometry.width,
+                        c_handle->userdata->geometry.height,
+                        coding));
                 }
                 else
                 {
@@ -3400,6 +4983,177 @@ int camwire::camwire::set_pixel_coding(const Camwire_bus_handle_ptr &c_handle, c
     }
 }
 
+int camwire::camwire::apply_state(const Camwire_bus_handle_ptr &c_handle, const Camwire_state_ptr &desired, int &applied)
+{
+    try
+    {
+        applied = 0;
+        ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(desired);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        ERROR_IF_NULL(internal_status->current_set);
+        dc1394video_mode_t video_mode = get_1394_video_mode(c_handle);
+        ERROR_IF_ZERO(video_mode);
+
+        /* A copy, because the setters below update the shadow state as
+           they go: */
+        const Camwire_state current = *internal_status->current_set;
+        Camwire_state wanted = *desired;
+        /* Ensure that video1394 lower limit is met: */
+        if (wanted.num_frame_buffers < 2)
+            wanted.num_frame_buffers = 2;
+
+        /* Work out everything that is needed before touching the camera,
+           so that a request which cannot be met changes nothing: */
+        int changes = state_changes(current, wanted);
+        if (changes & (CAMWIRE_CHANGED_FRAME_SIZE | CAMWIRE_CHANGED_FRAME_OFFSET))
+        {
+            if (!variable_image_size(video_mode))
+            {
+                DPRINTF("Attempt to change frame size or offset in a fixed image size format.");
+                return CAMWIRE_FAILURE;
+            }
+            /* An offset on its own is fitted by set_frame_offset(): */
+            if (changes & CAMWIRE_CHANGED_FRAME_SIZE)
+            {
+                ERROR_IF_CAMWIRE_FAIL(fit_frame_size(c_handle, wanted.left, wanted.top, wanted.width, wanted.height));
+                changes = state_changes(current, wanted);
+            }
+        }
+        if (changes == 0)
+            return CAMWIRE_SUCCESS;
+
+        int reconnect = changes & (CAMWIRE_CHANGED_NUM_BUFFERS | CAMWIRE_CHANGED_FRAME_SIZE);
+        if (changes & CAMWIRE_CHANGED_PIXEL_CODING)
+        {
+            if (!variable_image_size(video_mode))
+            {
+                DPRINTF("Attempt to set pixel coding in a fixed image size format.");
+                return CAMWIRE_FAILURE;
+            }
+            int old_depth, new_depth;
+            ERROR_IF_CAMWIRE_FAIL(pixel_depth(current.coding, old_depth));
+            ERROR_IF_CAMWIRE_FAIL(pixel_depth(wanted.coding, new_depth));
+            if (new_depth != old_depth)
+                reconnect = 1;
+        }
+
+        if (reconnect)
+        {
+            /* connect_cam() writes every register from the new settings, so
+               nothing else is left to do: */
+            Camwire_conf_ptr config(new Camwire_conf);
+            ERROR_IF_CAMWIRE_FAIL(get_config(c_handle, config));
+            if (current.running)
+            {
+                ERROR_IF_CAMWIRE_FAIL(set_run_stop(c_handle, 0));
+                ERROR_IF_CAMWIRE_FAIL(wait_for_stop(c_handle));
+            }
+            disconnect_cam(c_handle);
+            Camwire_state_ptr settings(new Camwire_state(wanted));
+            ERROR_IF_CAMWIRE_FAIL(connect_cam(c_handle, config, settings));
+            applied = changes | CAMWIRE_CHANGED_RECONNECT;
+            return CAMWIRE_SUCCESS;
+        }
+
+        /* A camera that is to stop is stopped first, so that it sends no
+           frames taken with half of the new settings: */
+        if ((changes & CAMWIRE_CHANGED_RUNNING) && !wanted.running)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_run_stop(c_handle, 0));
+            ERROR_IF_CAMWIRE_FAIL(wait_for_stop(c_handle));
+            applied |= CAMWIRE_CHANGED_RUNNING;
+        }
+        if (changes & CAMWIRE_CHANGED_SHADOW)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_stateshadow(c_handle, wanted.shadow));
+            applied |= CAMWIRE_CHANGED_SHADOW;
+        }
+        if (changes & CAMWIRE_CHANGED_FRAME_OFFSET)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_frame_offset(c_handle, wanted.left, wanted.top));
+            applied |= CAMWIRE_CHANGED_FRAME_OFFSET;
+        }
+        /* Same-depth codings are switched in place by set_pixel_coding(): */
+        if (changes & CAMWIRE_CHANGED_PIXEL_CODING)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_pixel_coding(c_handle, wanted.coding));
+            applied |= CAMWIRE_CHANGED_PIXEL_CODING;
+        }
+        /* After the coding, which the Format 7 packet size depends on: */
+        if (changes & CAMWIRE_CHANGED_FRAME_RATE)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_framerate(c_handle, wanted.frame_rate));
+            applied |= CAMWIRE_CHANGED_FRAME_RATE;
+        }
+        if (changes & CAMWIRE_CHANGED_TRIGGER_SOURCE)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_trigger_source(c_handle, wanted.external_trigger));
+            applied |= CAMWIRE_CHANGED_TRIGGER_SOURCE;
+        }
+        if (changes & CAMWIRE_CHANGED_TRIGGER_POLARITY)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_trigger_polarity(c_handle, wanted.trigger_polarity));
+            applied |= CAMWIRE_CHANGED_TRIGGER_POLARITY;
+        }
+        if (changes & CAMWIRE_CHANGED_SHUTTER)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_shutter(c_handle, wanted.shutter));
+            applied |= CAMWIRE_CHANGED_SHUTTER;
+        }
+        if (changes & CAMWIRE_CHANGED_GAIN)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_gain(c_handle, wanted.gain));
+            applied |= CAMWIRE_CHANGED_GAIN;
+        }
+        if (changes & CAMWIRE_CHANGED_BRIGHTNESS)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_brightness(c_handle, wanted.brightness));
+            applied |= CAMWIRE_CHANGED_BRIGHTNESS;
+        }
+        if (changes & CAMWIRE_CHANGED_WHITE_BALANCE)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_white_balance(c_handle, wanted.white_balance));
+            applied |= CAMWIRE_CHANGED_WHITE_BALANCE;
+        }
+        /* Coefficients before the switch, so that no frame is corrected
+           with the old matrix once it is on: */
+        if (changes & CAMWIRE_CHANGED_COLOUR_COEF)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_colour_coefficients(c_handle, wanted.colour_coef));
+            applied |= CAMWIRE_CHANGED_COLOUR_COEF;
+        }
+        if (changes & CAMWIRE_CHANGED_COLOUR_CORR)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_colour_correction(c_handle, wanted.colour_corr));
+            applied |= CAMWIRE_CHANGED_COLOUR_CORR;
+        }
+        if (changes & CAMWIRE_CHANGED_GAMMA)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_gamma(c_handle, wanted.gamma));
+            applied |= CAMWIRE_CHANGED_GAMMA;
+        }
+        if (changes & CAMWIRE_CHANGED_SINGLE_SHOT)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_single_shot(c_handle, wanted.single_shot));
+            applied |= CAMWIRE_CHANGED_SINGLE_SHOT;
+        }
+        /* Last, so that a started camera runs with all the new settings: */
+        if ((changes & CAMWIRE_CHANGED_RUNNING) && wanted.running)
+        {
+            ERROR_IF_CAMWIRE_FAIL(set_run_stop(c_handle, wanted.running));
+            applied |= CAMWIRE_CHANGED_RUNNING;
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to apply state");
+        return CAMWIRE_FAILURE;
+    }
+}
+
 int camwire::camwire::get_state(const Camwire_bus_handle_ptr &c_handle, Camwire_state_ptr &set)
 {
     try
@@ -4141,7 +5895,6 @@ int camwire::camwire::get_frame_size(const Camwire_bus_handle_ptr &c_handle, int
         height = shadow_state->height;
 
         dc1394video_mode_t video_mode;
-        std::shared_ptr<dc1394video_frame_t> capture_frame(new dc1394video_frame_t);
         uint32_t width_val, height_val;
 
         if(!shadow_state->shadow)
@@ -4150,14 +5903,19 @@ int camwire::camwire::get_frame_size(const Camwire_bus_handle_ptr &c_handle, int
             ERROR_IF_ZERO(video_mode);
             if(fixed_image_size(video_mode))
             {
-                ERROR_IF_CAMWIRE_FAIL(get_captureframe(c_handle, capture_frame));
-                if(capture_frame->size[0] == 0 || capture_frame->size[1] == 0)
+                /* The size follows from the mode, and unlike the captured
+                   frame it is also known before the first frame arrives: */
+                ERROR_IF_DC1394_FAIL(dc1394_get_image_size_from_video_mode(c_handle->camera.get(),
+                            video_mode,
+                            &width_val,
+                            &height_val));
+                if(width_val == 0 || height_val == 0)
                 {
-                    DPRINTF("dc1394video_frame_t containes a zero frame size");
+                    DPRINTF("dc1394_get_image_size_from_video_mode() returned a zero frame size");
                     return CAMWIRE_FAILURE;
                 }
-                width = capture_frame->size[0];
-                height = capture_frame->size[1];
+                width = width_val;
+                height = height_val;
             }
             else if(variable_image_size(video_mode))
             {
@@ -4241,12 +5999,10 @@ int camwire::camwire::get_framebuffer_lag(const Camwire_bus_handle_ptr &c_handle
     try
     {
         ERROR_IF_NULL(c_handle);
-        std::shared_ptr<dc1394video_frame_t> capture_frame(new dc1394video_frame_t);
-        if(!capture_frame)
-            buffer_lag = 0;
-        else
-            buffer_lag = capture_frame->frames_behind;
-
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        /* Taken from the frame actually dequeued last: */
+        buffer_lag = internal_status->last_lag;
         return CAMWIRE_SUCCESS;
     }
     catch(std::runtime_error &re)
@@ -4256,6 +6012,167 @@ int camwire::camwire::get_framebuffer_lag(const Camwire_bus_handle_ptr &c_handle
     }
 }
 
+int camwire::camwire::get_timestamp(const Camwire_bus_handle_ptr &c_handle, double &timestamp)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        timestamp = convert_dma_timestamp(internal_status, internal_status->dma_timestamp);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get time stamp");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::get_framenumber(const Camwire_bus_handle_ptr &c_handle, int64_t &frame_number)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        frame_number = internal_status->frame_number;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get frame number");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::get_capture_stats(const Camwire_bus_handle_ptr &c_handle, Camwire_capture_stats &stats)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        stats.frames_delivered = internal_status->frames_delivered;
+        stats.frames_dropped = internal_status->frames_dropped;
+        stats.frames_skipped = internal_status->frames_skipped;
+        stats.last_lag = internal_status->last_lag;
+        stats.max_lag = internal_status->max_lag;
+        stats.ring_high_water = internal_status->ring_high_water;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get capture statistics");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::reset_capture_stats(const Camwire_bus_handle_ptr &c_handle)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        internal_status->frames_delivered = 0;
+        internal_status->frames_dropped = 0;
+        internal_status->frames_skipped = 0;
+        internal_status->last_lag = 0;
+        internal_status->max_lag = 0;
+        internal_status->ring_high_water = 0;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to reset capture statistics");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::set_image_stats(const Camwire_bus_handle_ptr &c_handle, const int enable, const int step,
+                                      const int left, const int top, const int roi_width,
+                                      const int roi_height)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        if (step < 1 || left < 0 || top < 0 || roi_width < 0 || roi_height < 0)
+        {
+            DPRINTF("Invalid image statistics step or region.");
+            return CAMWIRE_FAILURE;
+        }
+
+        std::lock_guard<std::mutex> lock(internal_status->stats_mutex);
+        internal_status->stats_enabled = (enable != 0);
+        internal_status->stats_step = step;
+        internal_status->stats_roi[0] = left;
+        internal_status->stats_roi[1] = top;
+        internal_status->stats_roi[2] = roi_width;
+        internal_status->stats_roi[3] = roi_height;
+        internal_status->image_stats.reset();
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to set image statistics");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::get_image_stats(const Camwire_bus_handle_ptr &c_handle, Camwire_image_stats &stats)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+        std::shared_ptr<const Camwire_image_stats> latest;
+        {
+            std::lock_guard<std::mutex> lock(internal_status->stats_mutex);
+            latest = internal_status->image_stats;
+        }
+        stats = latest ? *latest : Camwire_image_stats();
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to get image statistics");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwire::wait_image_stats(const Camwire_bus_handle_ptr &c_handle, Camwire_image_stats &stats,
+                                       const int64_t after_frame, const double timeout)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        std::unique_lock<std::mutex> lock(internal_status->stats_mutex);
+        auto is_newer = [&internal_status, after_frame]() {
+            return internal_status->image_stats && internal_status->image_stats->frame_number > after_frame;
+        };
+        if (timeout < 0.0)
+            internal_status->stats_ready.wait(lock, is_newer);
+        else
+            internal_status->stats_ready.wait_for(lock, std::chrono::duration<double>(timeout), is_newer);
+        std::shared_ptr<const Camwire_image_stats> latest = internal_status->image_stats;
+        lock.unlock();
+        stats = latest ? *latest : Camwire_image_stats();
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to wait for image statistics");
+        return CAMWIRE_FAILURE;
+    }
+}
+
 int camwire::camwire::get_stateshadow(const Camwire_bus_handle_ptr &c_handle, int &shadow)
 {
     try
@@ -0,0 +1,90 @@
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+    Title: Camwire frame
+
+    Description:
+    Move-only view of a held DMA frame buffer.  The fields are filled in
+    by camwire::dequeue_frame().
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+#include <camwire_frame.hpp>
+#include <camwire.hpp>
+
+camwire::Camwire_frame::Camwire_frame():
+    owner(0), buffer(0), bytes(0), frame_width(0), frame_height(0),
+    pixel_coding(CAMWIRE_PIXEL_INVALID), row_stride(0), number(0),
+    dma_timestamp(0), lag(0), generation(0)
+{
+}
+
+camwire::Camwire_frame::~Camwire_frame()
+{
+    release();
+}
+
+camwire::Camwire_frame::Camwire_frame(Camwire_frame &&other) noexcept:
+    owner(other.owner), handle(std::move(other.handle)), buffer(other.buffer),
+    bytes(other.bytes), frame_width(other.frame_width),
+    frame_height(other.frame_height), pixel_coding(other.pixel_coding),
+    row_stride(other.row_stride), number(other.number),
+    dma_timestamp(other.dma_timestamp), lag(other.lag),
+    generation(other.generation), stats(std::move(other.stats))
+{
+    other.owner = 0;
+    other.buffer = 0;
+}
+
+camwire::Camwire_frame& camwire::Camwire_frame::operator=(Camwire_frame &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        owner = other.owner;
+        handle = std::move(other.handle);
+        buffer = other.buffer;
+        bytes = other.bytes;
+        frame_width = other.frame_width;
+        frame_height = other.frame_height;
+        pixel_coding = other.pixel_coding;
+        row_stride = other.row_stride;
+        number = other.number;
+        dma_timestamp = other.dma_timestamp;
+        lag = other.lag;
+        generation = other.generation;
+        stats = std::move(other.stats);
+        other.owner = 0;
+        other.buffer = 0;
+    }
+    return *this;
+}
+
+int camwire::Camwire_frame::release()
+{
+    int status = CAMWIRE_SUCCESS;
+    if (buffer && owner)
+        status = owner->release_frame(handle, buffer, generation);
+    owner = 0;
+    buffer = 0;
+    bytes = 0;
+    handle.reset();
+    stats.reset();
+    return status;
+}
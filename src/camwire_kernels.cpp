@@ -0,0 +1,2305 @@
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+    Title: Camwire pixel kernels
+
+    Description:
+    Scalar and SIMD implementations of the pixel kernels declared in
+    camwire_kernels.hpp.  The SIMD versions are compiled with per-function
+    target attributes, so the library as a whole still runs on any x86
+    CPU, and are only called after checking the CPU at run time.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+#include <camwire_kernels.hpp>
+#include <algorithm>        //std::min
+#include <cstdlib>          //abs
+#include <cstring>          //memcpy
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CAMWIRE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    typedef void (*Lookup_8to16_fn)(const uint8_t *, uint16_t *, const size_t, const uint16_t *);
+
+    void lookup_8to16_scalar(const uint8_t *inp, uint16_t *outp, const size_t num_components, const uint16_t *lut)
+    {
+        size_t i = 0;
+        /* Unrolled, so that the loads of the next few table entries are
+           not held up by the loop counter: */
+        for (; i + 8 <= num_components; i += 8)
+        {
+            outp[i]   = lut[inp[i]];
+            outp[i+1] = lut[inp[i+1]];
+            outp[i+2] = lut[inp[i+2]];
+            outp[i+3] = lut[inp[i+3]];
+            outp[i+4] = lut[inp[i+4]];
+            outp[i+5] = lut[inp[i+5]];
+            outp[i+6] = lut[inp[i+6]];
+            outp[i+7] = lut[inp[i+7]];
+        }
+        for (; i < num_components; ++i)
+            outp[i] = lut[inp[i]];
+    }
+
+#ifdef CAMWIRE_X86_DISPATCH
+    /* AVX2 has no 16-bit gather, so the table is widened to 32 bits and
+       eight entries are gathered at a time: */
+    __attribute__((target("avx2")))
+    void lookup_8to16_avx2(const uint8_t *inp, uint16_t *outp, const size_t num_components, const uint16_t *lut)
+    {
+        int32_t lut32[256];
+        for (int v = 0; v < 256; ++v)
+            lut32[v] = lut[v];
+
+        size_t i = 0;
+        for (; i + 16 <= num_components; i += 16)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(inp + i));
+            __m256i idx_lo = _mm256_cvtepu8_epi32(bytes);
+            __m256i idx_hi = _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8));
+            __m256i val_lo = _mm256_i32gather_epi32(lut32, idx_lo, 4);
+            __m256i val_hi = _mm256_i32gather_epi32(lut32, idx_hi, 4);
+            /* packus works within 128-bit lanes, so put the quadwords
+               back in order afterwards: */
+            __m256i packed = _mm256_packus_epi32(val_lo, val_hi);
+            packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(outp + i), packed);
+        }
+        lookup_8to16_scalar(inp + i, outp + i, num_components - i, lut);
+    }
+
+    /* AVX-512BW keeps the whole table in eight registers.  vpermt2w looks
+       up 64 entries from a register pair using the low 6 index bits, and
+       the top two bits choose between the four pairs: */
+    __attribute__((target("avx512f,avx512bw")))
+    void lookup_8to16_avx512(const uint8_t *inp, uint16_t *outp, const size_t num_components, const uint16_t *lut)
+    {
+        __m512i table[8];
+        for (int t = 0; t < 8; ++t)
+            table[t] = _mm512_loadu_si512(lut + 32*t);
+        const __m512i bit6 = _mm512_set1_epi16(0x40);
+        const __m512i bit7 = _mm512_set1_epi16(0x80);
+
+        size_t i = 0;
+        for (; i + 32 <= num_components; i += 32)
+        {
+            __m512i idx = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(inp + i)));
+            __m512i r0 = _mm512_permutex2var_epi16(table[0], idx, table[1]);
+            __m512i r1 = _mm512_permutex2var_epi16(table[2], idx, table[3]);
+            __m512i r2 = _mm512_permutex2var_epi16(table[4], idx, table[5]);
+            __m512i r3 = _mm512_permutex2var_epi16(table[6], idx, table[7]);
+            __mmask32 upper64 = _mm512_test_epi16_mask(idx, bit6);
+            __mmask32 upper128 = _mm512_test_epi16_mask(idx, bit7);
+            __m512i lower = _mm512_mask_blend_epi16(upper64, r0, r1);
+            __m512i upper = _mm512_mask_blend_epi16(upper64, r2, r3);
+            _mm512_storeu_si512(outp + i, _mm512_mask_blend_epi16(upper128, lower, upper));
+        }
+        lookup_8to16_scalar(inp + i, outp + i, num_components - i, lut);
+    }
+#endif
+
+    struct Lookup_8to16_impl
+    {
+        Lookup_8to16_fn fn;
+        const char *isa;
+    };
+
+    Lookup_8to16_impl select_lookup_8to16()
+    {
+        Lookup_8to16_impl impl = {lookup_8to16_scalar, "scalar"};
+#ifdef CAMWIRE_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512bw"))
+        {
+            impl.fn = lookup_8to16_avx512;
+            impl.isa = "avx512bw";
+        }
+        else if (__builtin_cpu_supports("avx2"))
+        {
+            impl.fn = lookup_8to16_avx2;
+            impl.isa = "avx2";
+        }
+#endif
+        return impl;
+    }
+
+    /* Chosen once, on first use: */
+    const Lookup_8to16_impl & lookup_8to16_impl()
+    {
+        static const Lookup_8to16_impl impl = select_lookup_8to16();
+        return impl;
+    }
+}
+
+namespace
+{
+    enum Bayer_colour
+    {
+        BAYER_RED,
+        BAYER_GREEN,
+        BAYER_BLUE
+    };
+
+    /* Colour of each site of a 2x2 tile, indexed by (y&1)*2 + (x&1).
+       Returns 0 if tiling is not a Bayer pattern: */
+    int bayer_pattern(const camwire::Camwire_tiling tiling, int pattern[4])
+    {
+        static const int rggb[4] = {BAYER_RED, BAYER_GREEN, BAYER_GREEN, BAYER_BLUE};
+        static const int gbrg[4] = {BAYER_GREEN, BAYER_BLUE, BAYER_RED, BAYER_GREEN};
+        static const int grbg[4] = {BAYER_GREEN, BAYER_RED, BAYER_BLUE, BAYER_GREEN};
+        static const int bggr[4] = {BAYER_BLUE, BAYER_GREEN, BAYER_GREEN, BAYER_RED};
+        const int *chosen;
+        switch (tiling)
+        {
+            case camwire::CAMWIRE_TILING_RGGB:  chosen = rggb;  break;
+            case camwire::CAMWIRE_TILING_GBRG:  chosen = gbrg;  break;
+            case camwire::CAMWIRE_TILING_GRBG:  chosen = grbg;  break;
+            case camwire::CAMWIRE_TILING_BGGR:  chosen = bggr;  break;
+            default:                            return 0;
+        }
+        for (int p = 0; p < 4; ++p)
+            pattern[p] = chosen[p];
+        return 1;
+    }
+
+    /* Mirrors a coordinate outside [0, n) back inside.  Mirroring about
+       the edge pixel keeps the parity, and so the colour, unchanged: */
+    inline int reflect(int v, const int n)
+    {
+        if (v < 0)
+            v = -v;
+        if (v >= n)
+            v = 2*n - 2 - v;
+        return v < 0 ? 0 : (v >= n ? n - 1 : v);  /* Images under 3 pixels.*/
+    }
+
+    inline int clamp_sample(const int v, const int max_val)
+    {
+        return v < 0 ? 0 : (v > max_val ? max_val : v);
+    }
+
+    template <int Bytes>
+    inline int load_sample(const uint8_t *row, const int x)
+    {
+        if (Bytes == 1)
+            return row[x];
+        return (row[2*x] << 8) | row[2*x + 1];  /* Network byte order.*/
+    }
+
+    template <int InBytes, int OutBytes>
+    inline void store_sample(uint8_t *out, const int v)
+    {
+        if (OutBytes == 1)
+            out[0] = static_cast<uint8_t>(InBytes == 1 ? v : v >> 8);
+        else
+        {
+            int w = (InBytes == 2 ? v : v*257);  /* 255 becomes 65535.*/
+            out[0] = static_cast<uint8_t>(w >> 8);
+            out[1] = static_cast<uint8_t>(w);
+        }
+    }
+
+    /* A Bayer source image, read with mirrored borders: */
+    struct Bayer_source
+    {
+        const uint8_t *data;
+        size_t stride;
+        int width;
+        int height;
+        const uint8_t * row(const int y) const {return data + reflect(y, height)*stride;}
+    };
+
+    /* Sample offsets of the output channels within a pixel: */
+    struct Bayer_channels
+    {
+        int red;
+        int green;
+        int blue;
+    };
+
+    template <int InBytes, int OutBytes>
+    inline void store_pixel(uint8_t *out_row, const int x, const Bayer_channels &ch,
+                            const int r, const int g, const int b)
+    {
+        uint8_t *out = out_row + x*3*OutBytes;
+        store_sample<InBytes, OutBytes>(out + ch.red*OutBytes, r);
+        store_sample<InBytes, OutBytes>(out + ch.green*OutBytes, g);
+        store_sample<InBytes, OutBytes>(out + ch.blue*OutBytes, b);
+    }
+
+    /* Which site of the 2x2 tile each colour of the nearest neighbour
+       output is taken from, green from the tile row y is on: */
+    struct Nearest_sites
+    {
+        int red;
+        int green;
+        int blue;
+    };
+
+    inline Nearest_sites nearest_sites(const int pattern[4], const int y)
+    {
+        Nearest_sites sites = {0, 0, 0};
+        for (int p = 0; p < 4; ++p)
+        {
+            if (pattern[p] == BAYER_RED)   sites.red = p;
+            if (pattern[p] == BAYER_BLUE)  sites.blue = p;
+        }
+        const int dy = y & 1;
+        sites.green = dy*2 + (pattern[dy*2] == BAYER_GREEN ? 0 : 1);
+        return sites;
+    }
+
+    /* Columns x_begin (even) to w - 1 of one output row: */
+    template <int InBytes, int OutBytes>
+    void nearest_span(const uint8_t *tile_rows[2], const Nearest_sites &sites, const int w,
+                      const int x_begin, uint8_t *out_row, const Bayer_channels &ch)
+    {
+        for (int x = x_begin; x < w; x += 2)
+        {
+            const int x1 = reflect(x + 1, w);
+            int v[4];
+            v[0] = load_sample<InBytes>(tile_rows[0], x);
+            v[1] = load_sample<InBytes>(tile_rows[0], x1);
+            v[2] = load_sample<InBytes>(tile_rows[1], x);
+            v[3] = load_sample<InBytes>(tile_rows[1], x1);
+            store_pixel<InBytes, OutBytes>(out_row, x, ch, v[sites.red], v[sites.green], v[sites.blue]);
+            if (x + 1 < w)
+                store_pixel<InBytes, OutBytes>(out_row, x + 1, ch, v[sites.red], v[sites.green], v[sites.blue]);
+        }
+    }
+
+    template <int InBytes, int OutBytes>
+    void nearest_row(const Bayer_source &src, const int pattern[4], const int y,
+                     uint8_t *out_row, const Bayer_channels &ch)
+    {
+        /* Every pixel takes its colours from the sites of its own 2x2
+           tile: */
+        const int top = y & ~1;
+        const uint8_t *tile_rows[2] = {src.row(top), src.row(top + 1)};
+        nearest_span<InBytes, OutBytes>(tile_rows, nearest_sites(pattern, y), src.width, 0, out_row, ch);
+    }
+
+    template <int InBytes, int OutBytes>
+    inline void bilinear_pixel(const uint8_t *up, const uint8_t *mid, const uint8_t *down,
+                               const int x, const int xm, const int xp, const int colour,
+                               const int red_row, uint8_t *out_row, const Bayer_channels &ch)
+    {
+        const int c = load_sample<InBytes>(mid, x);
+        int r, g, b;
+        if (colour == BAYER_GREEN)
+        {
+            int h = (load_sample<InBytes>(mid, xm) + load_sample<InBytes>(mid, xp) + 1) >> 1;
+            int v = (load_sample<InBytes>(up, x) + load_sample<InBytes>(down, x) + 1) >> 1;
+            g = c;
+            r = red_row ? h : v;
+            b = red_row ? v : h;
+        }
+        else
+        {
+            int orth = (load_sample<InBytes>(up, x) + load_sample<InBytes>(down, x) +
+                        load_sample<InBytes>(mid, xm) + load_sample<InBytes>(mid, xp) + 2) >> 2;
+            int diag = (load_sample<InBytes>(up, xm) + load_sample<InBytes>(up, xp) +
+                        load_sample<InBytes>(down, xm) + load_sample<InBytes>(down, xp) + 2) >> 2;
+            g = orth;
+            r = (colour == BAYER_RED) ? c : diag;
+            b = (colour == BAYER_RED) ? diag : c;
+        }
+        store_pixel<InBytes, OutBytes>(out_row, x, ch, r, g, b);
+    }
+
+    /* Columns x_begin to x_end - 1 of one output row.  The first and last
+       columns need mirrored neighbours, the interior does not: */
+    template <int InBytes, int OutBytes>
+    void bilinear_span(const uint8_t *up, const uint8_t *mid, const uint8_t *down,
+                       const int *colours, const int red_row, const int w, const int x_begin,
+                       const int x_end, uint8_t *out_row, const Bayer_channels &ch)
+    {
+        for (int x = x_begin; x < x_end; ++x)
+        {
+            const int xm = (x > 0 ? x - 1 : reflect(-1, w));
+            const int xp = (x < w - 1 ? x + 1 : reflect(x + 1, w));
+            bilinear_pixel<InBytes, OutBytes>(up, mid, down, x, xm, xp, colours[x & 1], red_row, out_row, ch);
+        }
+    }
+
+    template <int InBytes, int OutBytes>
+    void bilinear_row(const Bayer_source &src, const int pattern[4], const int y,
+                      uint8_t *out_row, const Bayer_channels &ch)
+    {
+        const int *colours = pattern + (y & 1)*2;
+        const int red_row = (colours[0] == BAYER_RED || colours[1] == BAYER_RED);
+        bilinear_span<InBytes, OutBytes>(src.row(y - 1), src.row(y), src.row(y + 1), colours, red_row,
+                                         src.width, 0, src.width, out_row, ch);
+    }
+
+    /* Green at a red or blue site, interpolated along the direction with
+       the weaker gradient and corrected by the curvature of the site's
+       own colour (Hamilton-Adams): */
+    template <int InBytes>
+    inline int edge_green(const uint8_t *rows[5], const int x, const int xm1, const int xp1,
+                          const int xm2, const int xp2, const int max_val)
+    {
+        const int c = load_sample<InBytes>(rows[2], x);
+        const int gl = load_sample<InBytes>(rows[2], xm1);
+        const int gr = load_sample<InBytes>(rows[2], xp1);
+        const int gu = load_sample<InBytes>(rows[1], x);
+        const int gd = load_sample<InBytes>(rows[3], x);
+        const int lap_h = 2*c - load_sample<InBytes>(rows[2], xm2) - load_sample<InBytes>(rows[2], xp2);
+        const int lap_v = 2*c - load_sample<InBytes>(rows[0], x) - load_sample<InBytes>(rows[4], x);
+        const int grad_h = abs(gl - gr) + abs(lap_h);
+        const int grad_v = abs(gu - gd) + abs(lap_v);
+        int g;
+        if (grad_h < grad_v)
+            g = (2*(gl + gr) + lap_h + 2) >> 2;
+        else if (grad_v < grad_h)
+            g = (2*(gu + gd) + lap_v + 2) >> 2;
+        else
+            g = (2*(gl + gr + gu + gd) + lap_h + lap_v + 4) >> 3;
+        return clamp_sample(g, max_val);
+    }
+
+    /* Columns x_begin to x_end - 1 of the green plane of one row.  Green
+       is kept in any integer type wide enough for the samples: */
+    template <int InBytes, typename Green>
+    void edge_green_span(const uint8_t *rows[5], const int *colours, const int w, const int x_begin,
+                         const int x_end, const int max_val, Green *green_row)
+    {
+        for (int x = x_begin; x < x_end; ++x)
+        {
+            if (colours[x & 1] == BAYER_GREEN)
+                green_row[x] = static_cast<Green>(load_sample<InBytes>(rows[2], x));
+            else if (x >= 2 && x < w - 2)
+                green_row[x] = static_cast<Green>(edge_green<InBytes>(rows, x, x - 1, x + 1, x - 2, x + 2,
+                                                                      max_val));
+            else
+                green_row[x] = static_cast<Green>(edge_green<InBytes>(rows, x, reflect(x - 1, w),
+                                                                      reflect(x + 1, w), reflect(x - 2, w),
+                                                                      reflect(x + 2, w), max_val));
+        }
+    }
+
+    /* Red and blue from the full green plane, by interpolating the colour
+       differences, which are smooth even across edges: */
+    template <int InBytes, int OutBytes, typename Green>
+    inline void edge_pixel(const uint8_t *up, const uint8_t *mid, const uint8_t *down,
+                           const Green *g_up, const Green *g_mid, const Green *g_down,
+                           const int x, const int xm, const int xp, const int colour,
+                           const int red_row, const int max_val, uint8_t *out_row,
+                           const Bayer_channels &ch)
+    {
+        const int g = g_mid[x];
+        int r, b;
+        if (colour == BAYER_GREEN)
+        {
+            int h = g + ((load_sample<InBytes>(mid, xm) - g_mid[xm] +
+                          load_sample<InBytes>(mid, xp) - g_mid[xp]) >> 1);
+            int v = g + ((load_sample<InBytes>(up, x) - g_up[x] +
+                          load_sample<InBytes>(down, x) - g_down[x]) >> 1);
+            h = clamp_sample(h, max_val);
+            v = clamp_sample(v, max_val);
+            r = red_row ? h : v;
+            b = red_row ? v : h;
+        }
+        else
+        {
+            const int c = load_sample<InBytes>(mid, x);
+            int diag = g + ((load_sample<InBytes>(up, xm) - g_up[xm] +
+                             load_sample<InBytes>(up, xp) - g_up[xp] +
+                             load_sample<InBytes>(down, xm) - g_down[xm] +
+                             load_sample<InBytes>(down, xp) - g_down[xp]) >> 2);
+            diag = clamp_sample(diag, max_val);
+            r = (colour == BAYER_RED) ? c : diag;
+            b = (colour == BAYER_RED) ? diag : c;
+        }
+        store_pixel<InBytes, OutBytes>(out_row, x, ch, r, g, b);
+    }
+
+    template <int InBytes, int OutBytes, typename Green>
+    void edge_pixel_span(const uint8_t *up, const uint8_t *mid, const uint8_t *down,
+                         const Green *g_up, const Green *g_mid, const Green *g_down,
+                         const int *colours, const int red_row, const int w, const int x_begin,
+                         const int x_end, const int max_val, uint8_t *out_row, const Bayer_channels &ch)
+    {
+        for (int x = x_begin; x < x_end; ++x)
+        {
+            const int xm = (x > 0 ? x - 1 : reflect(-1, w));
+            const int xp = (x < w - 1 ? x + 1 : reflect(x + 1, w));
+            edge_pixel<InBytes, OutBytes, Green>(up, mid, down, g_up, g_mid, g_down, x, xm, xp,
+                                                 colours[x & 1], red_row, max_val, out_row, ch);
+        }
+    }
+
+    /* Rows of the green plane an edge-aware band needs: its own and one
+       more on either side: */
+    inline void edge_green_rows(const Bayer_source &src, const int row_begin, const int row_end,
+                                int &g_begin, int &g_end)
+    {
+        g_begin = (row_begin > 0 ? row_begin - 1 : 0);
+        g_end = (row_end < src.height ? row_end + 1 : src.height);
+    }
+
+    template <int InBytes, int OutBytes>
+    void edge_aware_rows(const Bayer_source &src, const int pattern[4],
+                         uint8_t *dst, const size_t dst_stride, const Bayer_channels &ch,
+                         const int row_begin, const int row_end)
+    {
+        const int max_val = (InBytes == 1 ? 0xff : 0xffff);
+        const int w = src.width;
+        int g_begin, g_end;
+        edge_green_rows(src, row_begin, row_end, g_begin, g_end);
+        std::vector<int32_t> green(static_cast<size_t>(g_end - g_begin)*w);
+        for (int y = g_begin; y < g_end; ++y)
+        {
+            const uint8_t *rows[5];
+            for (int dy = -2; dy <= 2; ++dy)
+                rows[dy + 2] = src.row(y + dy);
+            edge_green_span<InBytes, int32_t>(rows, pattern + (y & 1)*2, w, 0, w, max_val,
+                                              &green[static_cast<size_t>(y - g_begin)*w]);
+        }
+
+        for (int y = row_begin; y < row_end; ++y)
+        {
+            const int32_t *g_up = &green[static_cast<size_t>(reflect(y - 1, src.height) - g_begin)*w];
+            const int32_t *g_mid = &green[static_cast<size_t>(y - g_begin)*w];
+            const int32_t *g_down = &green[static_cast<size_t>(reflect(y + 1, src.height) - g_begin)*w];
+            const int *colours = pattern + (y & 1)*2;
+            const int red_row = (colours[0] == BAYER_RED || colours[1] == BAYER_RED);
+            edge_pixel_span<InBytes, OutBytes, int32_t>(src.row(y - 1), src.row(y), src.row(y + 1),
+                                                        g_up, g_mid, g_down, colours, red_row, w, 0, w,
+                                                        max_val, dst + static_cast<size_t>(y - row_begin)*dst_stride, ch);
+        }
+    }
+
+    /* Band functions write output row row_begin at dst, so that a band
+       can go into a buffer of its own: */
+    typedef void (*Demosaic_band_fn)(const Bayer_source &, const int *, uint8_t *, const size_t,
+                                     const Bayer_channels &, const camwire::Camwire_demosaic,
+                                     const int, const int);
+
+    template <int InBytes, int OutBytes>
+    void demosaic_band(const Bayer_source &src, const int pattern[4],
+                       uint8_t *dst, const size_t dst_stride, const Bayer_channels &ch,
+                       const camwire::Camwire_demosaic method, const int row_begin, const int row_end)
+    {
+        if (method == camwire::CAMWIRE_DEMOSAIC_EDGE_AWARE)
+        {
+            edge_aware_rows<InBytes, OutBytes>(src, pattern, dst, dst_stride, ch, row_begin, row_end);
+            return;
+        }
+        for (int y = row_begin; y < row_end; ++y)
+        {
+            uint8_t *out_row = dst + static_cast<size_t>(y - row_begin)*dst_stride;
+            if (method == camwire::CAMWIRE_DEMOSAIC_NEAREST)
+                nearest_row<InBytes, OutBytes>(src, pattern, y, out_row, ch);
+            else
+                bilinear_row<InBytes, OutBytes>(src, pattern, y, out_row, ch);
+        }
+    }
+
+#ifdef CAMWIRE_X86_DISPATCH
+    /* The AVX2 demosaic works on sixteen output pixels at a time, from
+       column 2 while all its loads stay inside the row, and leaves the
+       borders to the scalar spans.  8-bit samples are held in 16-bit
+       lanes and 16-bit samples in 32-bit lanes, eight to a register, both
+       wide enough for every intermediate of the scalar arithmetic, so the
+       results are identical.  Each Lanes type wraps the instructions for
+       its lane width: */
+    struct Lanes16
+    {
+        enum {BYTES = 1, PIX = 16};
+        typedef int16_t Green;
+        __attribute__((target("avx2")))
+        static __m256i load(const uint8_t *row, const int x)
+        {
+            return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x)));
+        }
+        __attribute__((target("avx2")))
+        static __m256i load_green(const Green *row, const int x)
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x));
+        }
+        __attribute__((target("avx2")))
+        static void store_green(Green *row, const int x, const __m256i v)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(row + x), v);
+        }
+        __attribute__((target("avx2")))
+        static __m256i set1(const int v) {return _mm256_set1_epi16(static_cast<int16_t>(v));}
+        __attribute__((target("avx2")))
+        static __m256i add(const __m256i a, const __m256i b) {return _mm256_add_epi16(a, b);}
+        __attribute__((target("avx2")))
+        static __m256i sub(const __m256i a, const __m256i b) {return _mm256_sub_epi16(a, b);}
+        __attribute__((target("avx2")))
+        static __m256i abs(const __m256i a) {return _mm256_abs_epi16(a);}
+        __attribute__((target("avx2")))
+        static __m256i sra(const __m256i a, const int n) {return _mm256_sra_epi16(a, _mm_cvtsi32_si128(n));}
+        __attribute__((target("avx2")))
+        static __m256i less(const __m256i a, const __m256i b) {return _mm256_cmpgt_epi16(b, a);}
+        __attribute__((target("avx2")))
+        static __m256i clamp(const __m256i a, const __m256i max_val)
+        {
+            return _mm256_min_epi16(_mm256_max_epi16(a, _mm256_setzero_si256()), max_val);
+        }
+        /* Copies the first or second lane of each pair to both: */
+        __attribute__((target("avx2")))
+        static __m256i pair_first(const __m256i a)
+        {
+            return _mm256_shuffle_epi8(a, _mm256_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13,
+                                                           0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13));
+        }
+        __attribute__((target("avx2")))
+        static __m256i pair_second(const __m256i a)
+        {
+            return _mm256_shuffle_epi8(a, _mm256_setr_epi8(2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15,
+                                                           2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15));
+        }
+        __attribute__((target("avx2")))
+        static __m256i even_lanes() {return _mm256_set1_epi32(0x0000ffff);}
+        /* Sixteen 16-bit output samples from one register of sixteen
+           pixels: */
+        __attribute__((target("avx2")))
+        static __m256i output_words(const __m256i *parts, const int out_bytes)
+        {
+            return (out_bytes == 2 ? _mm256_mullo_epi16(parts[0], _mm256_set1_epi16(257)) : parts[0]);
+        }
+    };
+
+    struct Lanes32
+    {
+        enum {BYTES = 2, PIX = 8};
+        typedef int32_t Green;
+        __attribute__((target("avx2")))
+        static __m256i load(const uint8_t *row, const int x)
+        {
+            const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+            return _mm256_cvtepu16_epi32(_mm_shuffle_epi8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + 2*x)), swap));
+        }
+        __attribute__((target("avx2")))
+        static __m256i load_green(const Green *row, const int x)
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x));
+        }
+        __attribute__((target("avx2")))
+        static void store_green(Green *row, const int x, const __m256i v)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(row + x), v);
+        }
+        __attribute__((target("avx2")))
+        static __m256i set1(const int v) {return _mm256_set1_epi32(v);}
+        __attribute__((target("avx2")))
+        static __m256i add(const __m256i a, const __m256i b) {return _mm256_add_epi32(a, b);}
+        __attribute__((target("avx2")))
+        static __m256i sub(const __m256i a, const __m256i b) {return _mm256_sub_epi32(a, b);}
+        __attribute__((target("avx2")))
+        static __m256i abs(const __m256i a) {return _mm256_abs_epi32(a);}
+        __attribute__((target("avx2")))
+        static __m256i sra(const __m256i a, const int n) {return _mm256_sra_epi32(a, _mm_cvtsi32_si128(n));}
+        __attribute__((target("avx2")))
+        static __m256i less(const __m256i a, const __m256i b) {return _mm256_cmpgt_epi32(b, a);}
+        __attribute__((target("avx2")))
+        static __m256i clamp(const __m256i a, const __m256i max_val)
+        {
+            return _mm256_min_epi32(_mm256_max_epi32(a, _mm256_setzero_si256()), max_val);
+        }
+        __attribute__((target("avx2")))
+        static __m256i pair_first(const __m256i a) {return _mm256_shuffle_epi32(a, _MM_SHUFFLE(2, 2, 0, 0));}
+        __attribute__((target("avx2")))
+        static __m256i pair_second(const __m256i a) {return _mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 1, 1));}
+        __attribute__((target("avx2")))
+        static __m256i even_lanes() {return _mm256_set1_epi64x(0xffffffffLL);}
+        /* Sixteen 16-bit output samples from two registers of eight
+           pixels.  The samples are 0-65535, which packus keeps: */
+        __attribute__((target("avx2")))
+        static __m256i output_words(const __m256i *parts, const int out_bytes)
+        {
+            __m256i lo = parts[0], hi = parts[1];
+            if (out_bytes == 1)
+            {
+                lo = _mm256_srli_epi32(lo, 8);
+                hi = _mm256_srli_epi32(hi, 8);
+            }
+            return _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        }
+    };
+
+    /* pshufb masks which interleave three colour planes into packed
+       pixels: mask[plane][chunk] takes the bytes of 16-byte output chunk
+       from plane red, green or blue.  8-bit planes give 16 pixels in three
+       chunks, 16-bit planes 8 pixels, byte swapped to network order: */
+    void interleave_masks(const Bayer_channels &ch, const int out_bytes, int8_t mask[3][3][16])
+    {
+        const int position[3] = {ch.red, ch.green, ch.blue};
+        const int pixel_bytes = 3*out_bytes;
+        for (int p = 0; p < 3; ++p)
+            for (int j = 0; j < 3; ++j)
+                for (int i = 0; i < 16; ++i)
+                {
+                    const int k = 16*j + i;
+                    const int byte = k % out_bytes;
+                    if ((k % pixel_bytes)/out_bytes != position[p])
+                        mask[p][j][i] = -128;  /* Zero.*/
+                    else if (out_bytes == 1)
+                        mask[p][j][i] = static_cast<int8_t>(k/pixel_bytes);
+                    else
+                        mask[p][j][i] = static_cast<int8_t>(2*(k/pixel_bytes) + 1 - byte);
+                }
+    }
+
+    /* Stores the pixels of three 16-byte colour planes: */
+    __attribute__((target("avx2")))
+    inline void store_chunks(uint8_t *out, const __m128i planes[3], const __m128i mask[3][3])
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            __m128i chunk = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(planes[0], mask[0][j]),
+                                                      _mm_shuffle_epi8(planes[1], mask[1][j])),
+                                         _mm_shuffle_epi8(planes[2], mask[2][j]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16*j), chunk);
+        }
+    }
+
+    /* Stores sixteen pixels from red, green and blue planes of 16-bit
+       output samples: */
+    template <int OutBytes>
+    __attribute__((target("avx2")))
+    inline void store_pixels16(uint8_t *out, const __m256i r, const __m256i g, const __m256i b,
+                               const __m128i mask[3][3])
+    {
+        if (OutBytes == 1)
+        {
+            const __m256i rg = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, g), _MM_SHUFFLE(3, 1, 2, 0));
+            const __m256i bb = _mm256_permute4x64_epi64(_mm256_packus_epi16(b, b), _MM_SHUFFLE(3, 1, 2, 0));
+            const __m128i planes[3] = {_mm256_castsi256_si128(rg), _mm256_extracti128_si256(rg, 1),
+                                       _mm256_castsi256_si128(bb)};
+            store_chunks(out, planes, mask);
+        }
+        else
+        {
+            const __m128i low[3] = {_mm256_castsi256_si128(r), _mm256_castsi256_si128(g),
+                                    _mm256_castsi256_si128(b)};
+            const __m128i high[3] = {_mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1),
+                                     _mm256_extracti128_si256(b, 1)};
+            store_chunks(out, low, mask);
+            store_chunks(out + 48, high, mask);
+        }
+    }
+
+    /* All-ones in the lanes of green sites of a row: */
+    template <class Lanes>
+    __attribute__((target("avx2")))
+    inline __m256i green_lanes(const int *colours)
+    {
+        const __m256i even = Lanes::even_lanes();
+        return (colours[0] == BAYER_GREEN ? even : _mm256_andnot_si256(even, _mm256_set1_epi32(-1)));
+    }
+
+    /* Red and blue of a row from the site's own sample c and the
+       horizontal, vertical and diagonal estimates: */
+    __attribute__((target("avx2")))
+    inline void red_blue(const __m256i c, const __m256i h, const __m256i v, const __m256i diag,
+                         const __m256i green, const int red_row, __m256i &r, __m256i &b)
+    {
+        if (red_row)
+        {
+            r = _mm256_blendv_epi8(c, h, green);
+            b = _mm256_blendv_epi8(diag, v, green);
+        }
+        else
+        {
+            r = _mm256_blendv_epi8(diag, v, green);
+            b = _mm256_blendv_epi8(c, h, green);
+        }
+    }
+
+    template <class Lanes, int OutBytes>
+    __attribute__((target("avx2")))
+    void nearest_row_avx2(const Bayer_source &src, const int pattern[4], const int y,
+                          uint8_t *out_row, const Bayer_channels &ch, const __m128i mask[3][3])
+    {
+        enum {PARTS = 16/Lanes::PIX};
+        const int top = y & ~1;
+        const uint8_t *tile_rows[2] = {src.row(top), src.row(top + 1)};
+        const Nearest_sites sites = nearest_sites(pattern, y);
+        const int w = src.width;
+        int x = 0;
+        for (; x + 16 <= w; x += 16)
+        {
+            __m256i r[PARTS], g[PARTS], b[PARTS];
+            for (int k = 0; k < PARTS; ++k)
+            {
+                const int xs = x + k*Lanes::PIX;
+                const __m256i t0 = Lanes::load(tile_rows[0], xs), t1 = Lanes::load(tile_rows[1], xs);
+                const __m256i v[4] = {Lanes::pair_first(t0), Lanes::pair_second(t0),
+                                      Lanes::pair_first(t1), Lanes::pair_second(t1)};
+                r[k] = v[sites.red];
+                g[k] = v[sites.green];
+                b[k] = v[sites.blue];
+            }
+            store_pixels16<OutBytes>(out_row + x*3*OutBytes, Lanes::output_words(r, OutBytes),
+                                     Lanes::output_words(g, OutBytes), Lanes::output_words(b, OutBytes), mask);
+        }
+        nearest_span<Lanes::BYTES, OutBytes>(tile_rows, sites, w, x, out_row, ch);
+    }
+
+    template <class Lanes, int OutBytes>
+    __attribute__((target("avx2")))
+    void bilinear_row_avx2(const Bayer_source &src, const int pattern[4], const int y,
+                           uint8_t *out_row, const Bayer_channels &ch, const __m128i mask[3][3])
+    {
+        enum {PARTS = 16/Lanes::PIX};
+        const uint8_t *up = src.row(y - 1), *mid = src.row(y), *down = src.row(y + 1);
+        const int *colours = pattern + (y & 1)*2;
+        const int red_row = (colours[0] == BAYER_RED || colours[1] == BAYER_RED);
+        const int w = src.width;
+        const __m256i green = green_lanes<Lanes>(colours);
+        const __m256i one = Lanes::set1(1), two = Lanes::set1(2);
+        bilinear_span<Lanes::BYTES, OutBytes>(up, mid, down, colours, red_row, w, 0, std::min(2, w), out_row, ch);
+        int x = 2;
+        for (; x + 18 <= w; x += 16)
+        {
+            __m256i r[PARTS], g[PARTS], b[PARTS];
+            for (int k = 0; k < PARTS; ++k)
+            {
+                const int xs = x + k*Lanes::PIX;
+                const __m256i c = Lanes::load(mid, xs);
+                const __m256i left = Lanes::load(mid, xs - 1), right = Lanes::load(mid, xs + 1);
+                const __m256i above = Lanes::load(up, xs), below = Lanes::load(down, xs);
+                const __m256i across = Lanes::add(left, right), along = Lanes::add(above, below);
+                const __m256i h = Lanes::sra(Lanes::add(across, one), 1);
+                const __m256i v = Lanes::sra(Lanes::add(along, one), 1);
+                const __m256i orth = Lanes::sra(Lanes::add(Lanes::add(across, along), two), 2);
+                const __m256i corners = Lanes::add(Lanes::add(Lanes::load(up, xs - 1), Lanes::load(up, xs + 1)),
+                                                   Lanes::add(Lanes::load(down, xs - 1), Lanes::load(down, xs + 1)));
+                const __m256i diag = Lanes::sra(Lanes::add(corners, two), 2);
+                g[k] = _mm256_blendv_epi8(orth, c, green);
+                red_blue(c, h, v, diag, green, red_row, r[k], b[k]);
+            }
+            store_pixels16<OutBytes>(out_row + x*3*OutBytes, Lanes::output_words(r, OutBytes),
+                                     Lanes::output_words(g, OutBytes), Lanes::output_words(b, OutBytes), mask);
+        }
+        bilinear_span<Lanes::BYTES, OutBytes>(up, mid, down, colours, red_row, w, std::max(x, 2), w, out_row, ch);
+    }
+
+    template <class Lanes, int OutBytes>
+    __attribute__((target("avx2")))
+    void edge_aware_rows_avx2(const Bayer_source &src, const int pattern[4],
+                              uint8_t *dst, const size_t dst_stride, const Bayer_channels &ch,
+                              const int row_begin, const int row_end, const __m128i mask[3][3])
+    {
+        enum {PARTS = 16/Lanes::PIX, IN_BYTES = Lanes::BYTES};
+        typedef typename Lanes::Green Green;
+        const int max_val = (IN_BYTES == 1 ? 0xff : 0xffff);
+        const int w = src.width;
+        const __m256i two = Lanes::set1(2), four = Lanes::set1(4);
+        const __m256i max_lanes = Lanes::set1(max_val);
+        int g_begin, g_end;
+        edge_green_rows(src, row_begin, row_end, g_begin, g_end);
+        std::vector<Green> green_plane(static_cast<size_t>(g_end - g_begin)*w);
+        for (int y = g_begin; y < g_end; ++y)
+        {
+            const uint8_t *rows[5];
+            for (int dy = -2; dy <= 2; ++dy)
+                rows[dy + 2] = src.row(y + dy);
+            const int *colours = pattern + (y & 1)*2;
+            const __m256i green = green_lanes<Lanes>(colours);
+            Green *green_row = &green_plane[static_cast<size_t>(y - g_begin)*w];
+            edge_green_span<IN_BYTES, Green>(rows, colours, w, 0, std::min(2, w), max_val, green_row);
+            int x = 2;
+            for (; x + Lanes::PIX + 2 <= w; x += Lanes::PIX)
+            {
+                const __m256i c = Lanes::load(rows[2], x);
+                const __m256i gl = Lanes::load(rows[2], x - 1), gr = Lanes::load(rows[2], x + 1);
+                const __m256i gu = Lanes::load(rows[1], x), gd = Lanes::load(rows[3], x);
+                const __m256i c2 = Lanes::add(c, c);
+                const __m256i lap_h = Lanes::sub(Lanes::sub(c2, Lanes::load(rows[2], x - 2)),
+                                                 Lanes::load(rows[2], x + 2));
+                const __m256i lap_v = Lanes::sub(Lanes::sub(c2, Lanes::load(rows[0], x)),
+                                                 Lanes::load(rows[4], x));
+                const __m256i grad_h = Lanes::add(Lanes::abs(Lanes::sub(gl, gr)), Lanes::abs(lap_h));
+                const __m256i grad_v = Lanes::add(Lanes::abs(Lanes::sub(gu, gd)), Lanes::abs(lap_v));
+                const __m256i across = Lanes::add(gl, gr), along = Lanes::add(gu, gd);
+                const __m256i gh = Lanes::sra(Lanes::add(Lanes::add(Lanes::add(across, across), lap_h), two), 2);
+                const __m256i gv = Lanes::sra(Lanes::add(Lanes::add(Lanes::add(along, along), lap_v), two), 2);
+                const __m256i both = Lanes::add(across, along);
+                const __m256i gb = Lanes::sra(Lanes::add(Lanes::add(Lanes::add(both, both),
+                                                                    Lanes::add(lap_h, lap_v)), four), 3);
+                __m256i g = _mm256_blendv_epi8(gb, gv, Lanes::less(grad_v, grad_h));
+                g = Lanes::clamp(_mm256_blendv_epi8(g, gh, Lanes::less(grad_h, grad_v)), max_lanes);
+                Lanes::store_green(green_row, x, _mm256_blendv_epi8(g, c, green));
+            }
+            edge_green_span<IN_BYTES, Green>(rows, colours, w, std::max(x, 2), w, max_val, green_row);
+        }
+
+        for (int y = row_begin; y < row_end; ++y)
+        {
+            const uint8_t *up = src.row(y - 1), *mid = src.row(y), *down = src.row(y + 1);
+            const Green *g_up = &green_plane[static_cast<size_t>(reflect(y - 1, src.height) - g_begin)*w];
+            const Green *g_mid = &green_plane[static_cast<size_t>(y - g_begin)*w];
+            const Green *g_down = &green_plane[static_cast<size_t>(reflect(y + 1, src.height) - g_begin)*w];
+            const int *colours = pattern + (y & 1)*2;
+            const int red_row = (colours[0] == BAYER_RED || colours[1] == BAYER_RED);
+            const __m256i green = green_lanes<Lanes>(colours);
+            uint8_t *out_row = dst + static_cast<size_t>(y - row_begin)*dst_stride;
+            edge_pixel_span<IN_BYTES, OutBytes, Green>(up, mid, down, g_up, g_mid, g_down, colours, red_row,
+                                                       w, 0, std::min(2, w), max_val, out_row, ch);
+            int x = 2;
+            for (; x + 18 <= w; x += 16)
+            {
+                __m256i r[PARTS], g[PARTS], b[PARTS];
+                for (int k = 0; k < PARTS; ++k)
+                {
+                    const int xs = x + k*Lanes::PIX;
+                    g[k] = Lanes::load_green(g_mid, xs);
+                    const __m256i c = Lanes::load(mid, xs);
+                    const __m256i dl = Lanes::sub(Lanes::load(mid, xs - 1), Lanes::load_green(g_mid, xs - 1));
+                    const __m256i dr = Lanes::sub(Lanes::load(mid, xs + 1), Lanes::load_green(g_mid, xs + 1));
+                    const __m256i du = Lanes::sub(Lanes::load(up, xs), Lanes::load_green(g_up, xs));
+                    const __m256i dd = Lanes::sub(Lanes::load(down, xs), Lanes::load_green(g_down, xs));
+                    const __m256i corners = Lanes::add(
+                        Lanes::add(Lanes::sub(Lanes::load(up, xs - 1), Lanes::load_green(g_up, xs - 1)),
+                                   Lanes::sub(Lanes::load(up, xs + 1), Lanes::load_green(g_up, xs + 1))),
+                        Lanes::add(Lanes::sub(Lanes::load(down, xs - 1), Lanes::load_green(g_down, xs - 1)),
+                                   Lanes::sub(Lanes::load(down, xs + 1), Lanes::load_green(g_down, xs + 1))));
+                    const __m256i h = Lanes::clamp(Lanes::add(g[k], Lanes::sra(Lanes::add(dl, dr), 1)), max_lanes);
+                    const __m256i v = Lanes::clamp(Lanes::add(g[k], Lanes::sra(Lanes::add(du, dd), 1)), max_lanes);
+                    const __m256i diag = Lanes::clamp(Lanes::add(g[k], Lanes::sra(corners, 2)), max_lanes);
+                    red_blue(c, h, v, diag, green, red_row, r[k], b[k]);
+                }
+                store_pixels16<OutBytes>(out_row + x*3*OutBytes, Lanes::output_words(r, OutBytes),
+                                         Lanes::output_words(g, OutBytes), Lanes::output_words(b, OutBytes), mask);
+            }
+            edge_pixel_span<IN_BYTES, OutBytes, Green>(up, mid, down, g_up, g_mid, g_down, colours, red_row,
+                                                       w, std::max(x, 2), w, max_val, out_row, ch);
+        }
+    }
+
+    template <class Lanes, int OutBytes>
+    __attribute__((target("avx2")))
+    void demosaic_band_avx2(const Bayer_source &src, const int pattern[4],
+                            uint8_t *dst, const size_t dst_stride, const Bayer_channels &ch,
+                            const camwire::Camwire_demosaic method, const int row_begin, const int row_end)
+    {
+        int8_t mask_bytes[3][3][16];
+        interleave_masks(ch, OutBytes, mask_bytes);
+        __m128i mask[3][3];
+        for (int p = 0; p < 3; ++p)
+            for (int j = 0; j < 3; ++j)
+                mask[p][j] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(mask_bytes[p][j]));
+        if (method == camwire::CAMWIRE_DEMOSAIC_EDGE_AWARE)
+        {
+            edge_aware_rows_avx2<Lanes, OutBytes>(src, pattern, dst, dst_stride, ch, row_begin, row_end, mask);
+            return;
+        }
+        for (int y = row_begin; y < row_end; ++y)
+        {
+            uint8_t *out_row = dst + static_cast<size_t>(y - row_begin)*dst_stride;
+            if (method == camwire::CAMWIRE_DEMOSAIC_NEAREST)
+                nearest_row_avx2<Lanes, OutBytes>(src, pattern, y, out_row, ch, mask);
+            else
+                bilinear_row_avx2<Lanes, OutBytes>(src, pattern, y, out_row, ch, mask);
+        }
+    }
+#endif
+
+    /* Band functions indexed by input and output bytes per sample, less
+       one: */
+    struct Demosaic_impl
+    {
+        Demosaic_band_fn band[2][2];
+        const char *isa;
+    };
+
+    Demosaic_impl select_demosaic()
+    {
+        Demosaic_impl impl = {{{demosaic_band<1, 1>, demosaic_band<1, 2>},
+                               {demosaic_band<2, 1>, demosaic_band<2, 2>}}, "scalar"};
+#ifdef CAMWIRE_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            impl.band[0][0] = demosaic_band_avx2<Lanes16, 1>;
+            impl.band[0][1] = demosaic_band_avx2<Lanes16, 2>;
+            impl.band[1][0] = demosaic_band_avx2<Lanes32, 1>;
+            impl.band[1][1] = demosaic_band_avx2<Lanes32, 2>;
+            impl.isa = "avx2";
+        }
+#endif
+        return impl;
+    }
+
+    const Demosaic_impl & demosaic_impl()
+    {
+        static const Demosaic_impl impl = select_demosaic();
+        return impl;
+    }
+}
+
+namespace
+{
+    /* Where the samples of one group of pixels sharing a U and a V sample
+       are, in bytes from the start of the group: */
+    struct Yuv_layout
+    {
+        int group_pixels;
+        int group_bytes;
+        int y[4];
+        int u;
+        int v;
+    };
+
+    /* Returns the layout of a YUV coding, or null for other codings.
+       YUV422 is UYVY unless the camera says YUYV: */
+    const Yuv_layout * yuv_layout(const camwire::Camwire_pixel coding, const camwire::Camwire_tiling tiling)
+    {
+        static const Yuv_layout yuv444 = {1, 3, {1, 0, 0, 0}, 0, 2};
+        static const Yuv_layout uyvy = {2, 4, {1, 3, 0, 0}, 0, 2};
+        static const Yuv_layout yuyv = {2, 4, {0, 2, 0, 0}, 1, 3};
+        static const Yuv_layout yuv411 = {4, 6, {1, 2, 4, 5}, 0, 3};
+        switch (coding)
+        {
+            case camwire::CAMWIRE_PIXEL_YUV411:  return &yuv411;
+            case camwire::CAMWIRE_PIXEL_YUV422:  return (tiling == camwire::CAMWIRE_TILING_YUYV ? &yuyv : &uyvy);
+            case camwire::CAMWIRE_PIXEL_YUV444:  return &yuv444;
+            default:                             return 0;
+        }
+    }
+
+    /* Byte offsets of the output channels within a pixel, and the number
+       of bytes per pixel.  Gray output has only the luma: */
+    struct Yuv_channels
+    {
+        int red;
+        int blue;
+        int pixel_bytes;
+    };
+
+    typedef void (*Yuv_row_fn)(const uint8_t *, const int, const Yuv_layout &, const int *, uint8_t *, const Yuv_channels &);
+
+    /* Chroma term d*coef in Q8, rounded exactly as pmulhrsw does it for
+       (d << 7) and coef: */
+    inline int yuv_term(const int d, const int coef)
+    {
+        return (d*128*coef + (1 << 14)) >> 15;
+    }
+
+    inline uint8_t clamp_byte(const int v)
+    {
+        return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+
+    inline void store_rgb(uint8_t *out, const Yuv_channels &ch, const int r, const int g, const int b)
+    {
+        out[ch.red] = clamp_byte(r);
+        out[1] = clamp_byte(g);
+        out[ch.blue] = clamp_byte(b);
+    }
+
+    void yuv_row_scalar(const uint8_t *src, const int width, const Yuv_layout &layout,
+                        const int *coef, uint8_t *dst, const Yuv_channels &ch)
+    {
+        for (int x = 0; x < width; x += layout.group_pixels)
+        {
+            const uint8_t *group = src + (x/layout.group_pixels)*layout.group_bytes;
+            const int pixels = std::min(layout.group_pixels, width - x);
+            if (ch.pixel_bytes == 1)
+            {
+                for (int p = 0; p < pixels; ++p)
+                    dst[x + p] = group[layout.y[p]];
+                continue;
+            }
+            const int u = group[layout.u] - 128;
+            const int v = group[layout.v] - 128;
+            const int tr = yuv_term(v, coef[0]);
+            const int tg = yuv_term(u, coef[1]) + yuv_term(v, coef[2]);
+            const int tb = yuv_term(u, coef[3]);
+            for (int p = 0; p < pixels; ++p)
+            {
+                const int y = group[layout.y[p]];
+                store_rgb(dst + (x + p)*3, ch, y + tr, y - tg, y + tb);
+            }
+        }
+    }
+
+#ifdef CAMWIRE_X86_DISPATCH
+    /* Sixteen pixels at a time: each 128-bit lane takes eight pixels
+       (two UYVY groups of four bytes or two YUV411 groups of six), and
+       pshufb spreads Y, U and V out to 16-bit words for pmulhrsw.  YUV444
+       groups do not fit a lane evenly and are left to the scalar code: */
+    __attribute__((target("avx2")))
+    void yuv_row_avx2(const uint8_t *src, const int width, const Yuv_layout &layout,
+                      const int *coef, uint8_t *dst, const Yuv_channels &ch)
+    {
+        if (layout.group_pixels < 2)
+        {
+            yuv_row_scalar(src, width, layout, coef, dst, ch);
+            return;
+        }
+        const int lane_bytes = 8/layout.group_pixels*layout.group_bytes;
+        const size_t row_bytes = static_cast<size_t>(width/layout.group_pixels)*layout.group_bytes;
+        int8_t y_mask[16], u_mask[16], v_mask[16];
+        for (int p = 0; p < 8; ++p)
+        {
+            int base = p/layout.group_pixels*layout.group_bytes;
+            y_mask[2*p] = static_cast<int8_t>(base + layout.y[p % layout.group_pixels]);
+            u_mask[2*p] = static_cast<int8_t>(base + layout.u);
+            v_mask[2*p] = static_cast<int8_t>(base + layout.v);
+            y_mask[2*p + 1] = u_mask[2*p + 1] = v_mask[2*p + 1] = -128;  /* Zero.*/
+        }
+        const __m256i y_shuf = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y_mask)));
+        const __m256i u_shuf = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(u_mask)));
+        const __m256i v_shuf = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v_mask)));
+        const __m256i bias = _mm256_set1_epi16(128);
+        const __m256i c_rv = _mm256_set1_epi16(static_cast<int16_t>(coef[0]));
+        const __m256i c_gu = _mm256_set1_epi16(static_cast<int16_t>(coef[1]));
+        const __m256i c_gv = _mm256_set1_epi16(static_cast<int16_t>(coef[2]));
+        const __m256i c_bu = _mm256_set1_epi16(static_cast<int16_t>(coef[3]));
+
+        int x = 0;
+        size_t offset = 0;
+        /* The upper lane load reads 16 bytes, which may be more than its
+           eight pixels: */
+        for (; offset + lane_bytes + 16 <= row_bytes; x += 16, offset += 2*lane_bytes)
+        {
+            __m256i raw = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + offset))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + offset + lane_bytes)), 1);
+            __m256i y = _mm256_shuffle_epi8(raw, y_shuf);
+            if (ch.pixel_bytes == 1)
+            {
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(y, y), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm256_castsi256_si128(packed));
+                continue;
+            }
+            __m256i u = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_shuffle_epi8(raw, u_shuf), bias), 7);
+            __m256i v = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_shuffle_epi8(raw, v_shuf), bias), 7);
+            __m256i r = _mm256_add_epi16(y, _mm256_mulhrs_epi16(v, c_rv));
+            __m256i g = _mm256_sub_epi16(y, _mm256_add_epi16(_mm256_mulhrs_epi16(u, c_gu),
+                                                             _mm256_mulhrs_epi16(v, c_gv)));
+            __m256i b = _mm256_add_epi16(y, _mm256_mulhrs_epi16(u, c_bu));
+            /* packus saturates to 0-255 like clamp_byte(): */
+            uint8_t rg[32], bb[32];
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(rg),
+                                _mm256_permute4x64_epi64(_mm256_packus_epi16(r, g), _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(bb),
+                                _mm256_permute4x64_epi64(_mm256_packus_epi16(b, b), _MM_SHUFFLE(3, 1, 2, 0)));
+            uint8_t *out = dst + x*3;
+            for (int p = 0; p < 16; ++p, out += 3)
+            {
+                out[ch.red] = rg[p];
+                out[1] = rg[16 + p];
+                out[ch.blue] = bb[p];
+            }
+        }
+        yuv_row_scalar(src + offset, width - x, layout, coef, dst + x*ch.pixel_bytes, ch);
+    }
+#endif
+
+    struct Yuv_row_impl
+    {
+        Yuv_row_fn fn;
+        const char *isa;
+    };
+
+    Yuv_row_impl select_yuv_row()
+    {
+        Yuv_row_impl impl = {yuv_row_scalar, "scalar"};
+#ifdef CAMWIRE_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            impl.fn = yuv_row_avx2;
+            impl.isa = "avx2";
+        }
+#endif
+        return impl;
+    }
+
+    const Yuv_row_impl & yuv_row_impl()
+    {
+        static const Yuv_row_impl impl = select_yuv_row();
+        return impl;
+    }
+}
+
+namespace
+{
+    typedef void (*Be16_fn)(const uint8_t *, uint16_t *, const size_t, const int, const bool);
+
+    /* Assembling the sample from its bytes gives host order on any
+       host: */
+    void be16_to_native_scalar(const uint8_t *src, uint16_t *dst, const size_t num_components,
+                               const int shift, const bool is_signed)
+    {
+        for (size_t i = 0; i < num_components; ++i)
+        {
+            uint16_t v = static_cast<uint16_t>((src[2*i] << 8) | src[2*i + 1]);
+            if (shift > 0)
+                v = static_cast<uint16_t>(v << shift);
+            else if (shift < 0)
+                v = is_signed ? static_cast<uint16_t>(static_cast<int16_t>(v) >> -shift) :
+                                static_cast<uint16_t>(v >> -shift);
+            dst[i] = v;
+        }
+    }
+
+#ifdef CAMWIRE_X86_DISPATCH
+    __attribute__((target("avx2")))
+    void be16_to_native_avx2(const uint8_t *src, uint16_t *dst, const size_t num_components,
+                             const int shift, const bool is_signed)
+    {
+        const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                              1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+        const __m128i count = _mm_cvtsi32_si128(shift < 0 ? -shift : shift);
+        size_t i = 0;
+        for (; i + 16 <= num_components; i += 16)
+        {
+            __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2*i)), swap);
+            if (shift > 0)
+                v = _mm256_sll_epi16(v, count);
+            else if (shift < 0)
+                v = is_signed ? _mm256_sra_epi16(v, count) : _mm256_srl_epi16(v, count);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), v);
+        }
+        be16_to_native_scalar(src + 2*i, dst + i, num_components - i, shift, is_signed);
+    }
+#endif
+
+    struct Be16_impl
+    {
+        Be16_fn fn;
+        const char *isa;
+    };
+
+    Be16_impl select_be16_to_native()
+    {
+        Be16_impl impl = {be16_to_native_scalar, "scalar"};
+#ifdef CAMWIRE_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            impl.fn = be16_to_native_avx2;
+            impl.isa = "avx2";
+        }
+#endif
+        return impl;
+    }
+
+    const Be16_impl & be16_to_native_impl()
+    {
+        static const Be16_impl impl = select_be16_to_native();
+        return impl;
+    }
+}
+
+void camwire::kernels::lookup_8to16(const uint8_t *inp, uint16_t *outp, const size_t num_components, const uint16_t lut[256])
+{
+    lookup_8to16_impl().fn(inp, outp, num_components, lut);
+}
+
+const char * camwire::kernels::lookup_8to16_isa()
+{
+    return lookup_8to16_impl().isa;
+}
+
+int camwire::kernels::output_bytes(const Camwire_output output)
+{
+    switch (output)
+    {
+        case CAMWIRE_OUTPUT_GRAY8:   return 1;
+        case CAMWIRE_OUTPUT_GRAY16:  return 2;
+        case CAMWIRE_OUTPUT_RGB8:
+        case CAMWIRE_OUTPUT_BGR8:    return 3;
+        case CAMWIRE_OUTPUT_RGB16:   return 6;
+        default:                     return 0;
+    }
+}
+
+namespace
+{
+    /* demosaic_rows() and yuv_to_rgb_rows() with output row dst_first_row
+       at dst, as for convert_rows(): */
+    int demosaic_strip(const uint8_t *src, const size_t src_stride, const int width, const int height,
+                       const int src_bytes, const camwire::Camwire_tiling tiling,
+                       uint8_t *dst, const size_t dst_stride, const int dst_first_row,
+                       const camwire::Camwire_output output, const camwire::Camwire_demosaic method,
+                       const int row_begin, const int row_end)
+    {
+        using namespace camwire;
+        int pattern[4];
+        if (!bayer_pattern(tiling, pattern))
+            return 0;
+        if (width < 1 || height < 1 || row_begin < 0 || row_end > height || row_begin > row_end ||
+            dst_first_row > row_begin)
+            return 0;
+        if (row_begin == row_end)
+            return 1;   /* Only checking the arguments.*/
+
+        Bayer_source source;
+        source.data = src;
+        source.stride = src_stride;
+        source.width = width;
+        source.height = height;
+        Bayer_channels ch;
+        ch.green = 1;
+        if (output == CAMWIRE_OUTPUT_BGR8)
+        {
+            ch.red = 2;
+            ch.blue = 0;
+        }
+        else
+        {
+            ch.red = 0;
+            ch.blue = 2;
+        }
+
+        int out_bytes;
+        if (output == CAMWIRE_OUTPUT_RGB8 || output == CAMWIRE_OUTPUT_BGR8)
+            out_bytes = 1;
+        else if (output == CAMWIRE_OUTPUT_RGB16)
+            out_bytes = 2;
+        else
+            return 0;
+        if (src_bytes != 1 && src_bytes != 2)
+            return 0;
+        uint8_t *strip = dst + static_cast<size_t>(row_begin - dst_first_row)*dst_stride;
+        demosaic_impl().band[src_bytes - 1][out_bytes - 1](source, pattern, strip, dst_stride, ch, method,
+                                                          row_begin, row_end);
+        return 1;
+    }
+
+    int yuv_strip(const uint8_t *src, const size_t src_stride, const int width,
+                  const camwire::Camwire_pixel coding, const camwire::Camwire_tiling tiling,
+                  uint8_t *dst, const size_t dst_stride, const int dst_first_row,
+                  const camwire::Camwire_output output, const camwire::Camwire_yuv_matrix matrix,
+                  const int row_begin, const int row_end)
+    {
+        using namespace camwire;
+        /* R = Y + 1.402V, G = Y - 0.344U - 0.714V, B = Y + 1.772U for
+           BT.601 and the BT.709 equivalents, in Q8: */
+        static const int bt601[4] = {359, 88, 183, 454};
+        static const int bt709[4] = {403, 48, 120, 475};
+        const Yuv_layout *layout = yuv_layout(coding, tiling);
+        if (!layout)
+            return 0;
+        Yuv_channels ch;
+        switch (output)
+        {
+            case CAMWIRE_OUTPUT_GRAY8:  ch.red = 0;  ch.blue = 0;  ch.pixel_bytes = 1;  break;
+            case CAMWIRE_OUTPUT_RGB8:   ch.red = 0;  ch.blue = 2;  ch.pixel_bytes = 3;  break;
+            case CAMWIRE_OUTPUT_BGR8:   ch.red = 2;  ch.blue = 0;  ch.pixel_bytes = 3;  break;
+            default:                    return 0;
+        }
+        if (width < 1 || row_begin < 0 || row_begin > row_end || dst_first_row > row_begin)
+            return 0;
+
+        const int *coef = (matrix == CAMWIRE_YUV_BT709 ? bt709 : bt601);
+        Yuv_row_fn row_fn = yuv_row_impl().fn;
+        for (int y = row_begin; y < row_end; ++y)
+            row_fn(src + y*src_stride, width, *layout, coef, dst + static_cast<size_t>(y - dst_first_row)*dst_stride,
+                   ch);
+        return 1;
+    }
+}
+
+int camwire::kernels::demosaic_rows(const uint8_t *src, const size_t src_stride, const int width, const int height,
+                                    const int src_bytes, const Camwire_tiling tiling,
+                                    uint8_t *dst, const size_t dst_stride, const Camwire_output output,
+                                    const Camwire_demosaic method, const int row_begin, const int row_end)
+{
+    return demosaic_strip(src, src_stride, width, height, src_bytes, tiling, dst, dst_stride, 0,
+                          output, method, row_begin, row_end);
+}
+
+const char * camwire::kernels::demosaic_isa()
+{
+    return demosaic_impl().isa;
+}
+
+int camwire::kernels::yuv_to_rgb_rows(const uint8_t *src, const size_t src_stride, const int width,
+                                      const Camwire_pixel coding, const Camwire_tiling tiling,
+                                      uint8_t *dst, const size_t dst_stride, const Camwire_output output,
+                                      const Camwire_yuv_matrix matrix, const int row_begin, const int row_end)
+{
+    return yuv_strip(src, src_stride, width, coding, tiling, dst, dst_stride, 0, output, matrix,
+                     row_begin, row_end);
+}
+
+const char * camwire::kernels::yuv_to_rgb_isa()
+{
+    return yuv_row_impl().isa;
+}
+
+void camwire::kernels::be16_to_native(const uint8_t *src, uint16_t *dst, const size_t num_components,
+                                      const int shift, const bool is_signed)
+{
+    be16_to_native_impl().fn(src, dst, num_components, shift, is_signed);
+}
+
+const char * camwire::kernels::be16_to_native_isa()
+{
+    return be16_to_native_impl().isa;
+}
+
+namespace
+{
+    enum Convert_kind
+    {
+        CONVERT_NONE,
+        CONVERT_COPY,           /* Same layout.*/
+        CONVERT_WIDEN,          /* 8-bit components to 16 through the table.*/
+        CONVERT_NARROW,         /* 16-bit components to 8.*/
+        CONVERT_GRAY_TO_RGB,
+        CONVERT_RGB_TO_GRAY,
+        CONVERT_SWAP_RB,
+        CONVERT_DEMOSAIC,
+        CONVERT_YUV
+    };
+
+    int is_bayer(const camwire::Camwire_tiling tiling)
+    {
+        return tiling == camwire::CAMWIRE_TILING_RGGB || tiling == camwire::CAMWIRE_TILING_GBRG ||
+               tiling == camwire::CAMWIRE_TILING_GRBG || tiling == camwire::CAMWIRE_TILING_BGGR;
+    }
+
+    /* Picks the conversion, and the source's channels and bytes per
+       component: */
+    Convert_kind convert_kind(const camwire::Camwire_pixel coding, const camwire::Camwire_tiling tiling,
+                              const camwire::Camwire_output output, int &channels, int &src_bytes)
+    {
+        using namespace camwire;
+        switch (coding)
+        {
+            case CAMWIRE_PIXEL_MONO8:
+            case CAMWIRE_PIXEL_RAW8:     channels = 1;  src_bytes = 1;  break;
+            case CAMWIRE_PIXEL_MONO16:
+            case CAMWIRE_PIXEL_RAW16:    channels = 1;  src_bytes = 2;  break;
+            case CAMWIRE_PIXEL_RGB8:     channels = 3;  src_bytes = 1;  break;
+            case CAMWIRE_PIXEL_RGB16:    channels = 3;  src_bytes = 2;  break;
+            case CAMWIRE_PIXEL_YUV411:
+            case CAMWIRE_PIXEL_YUV422:
+            case CAMWIRE_PIXEL_YUV444:
+                return (output == CAMWIRE_OUTPUT_GRAY8 || output == CAMWIRE_OUTPUT_RGB8 ||
+                        output == CAMWIRE_OUTPUT_BGR8) ? CONVERT_YUV : CONVERT_NONE;
+            case CAMWIRE_PIXEL_MONO16S:
+                return output == CAMWIRE_OUTPUT_GRAY16 ? CONVERT_COPY : CONVERT_NONE;
+            default:
+                return CONVERT_NONE;
+        }
+        const int out_channels = (output == CAMWIRE_OUTPUT_GRAY8 || output == CAMWIRE_OUTPUT_GRAY16) ? 1 : 3;
+        const int out_bytes = (output == CAMWIRE_OUTPUT_GRAY16 || output == CAMWIRE_OUTPUT_RGB16) ? 2 : 1;
+        if (output == CAMWIRE_OUTPUT_INVALID)
+            return CONVERT_NONE;
+        if (channels == 1 && out_channels == 3)
+        {
+            if (is_bayer(tiling))
+                return CONVERT_DEMOSAIC;
+            return coding == CAMWIRE_PIXEL_MONO8 || coding == CAMWIRE_PIXEL_MONO16 ?
+                CONVERT_GRAY_TO_RGB : CONVERT_NONE;
+        }
+        if (channels == 3 && out_channels == 1)
+            return CONVERT_RGB_TO_GRAY;
+        if (output == CAMWIRE_OUTPUT_BGR8)
+            return CONVERT_SWAP_RB;
+        if (src_bytes == out_bytes)
+            return CONVERT_COPY;
+        return src_bytes == 1 ? CONVERT_WIDEN : CONVERT_NARROW;
+    }
+
+    /* Reads component i of a row as 8 bits or as 16 bits in host order,
+       widening 8-bit components through lut: */
+    template <int SrcBytes, int OutBytes>
+    inline int read_component(const uint8_t *row, const int i, const uint16_t *lut)
+    {
+        if (SrcBytes == 2)
+            return OutBytes == 2 ? (row[2*i] << 8) | row[2*i + 1] : row[2*i];
+        if (OutBytes == 2)
+        {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t *>(lut + row[i]);
+            return (bytes[0] << 8) | bytes[1];
+        }
+        return row[i];
+    }
+
+    template <int OutBytes>
+    inline void write_component(uint8_t *row, const int i, const int v)
+    {
+        if (OutBytes == 2)
+        {
+            row[2*i] = static_cast<uint8_t>(v >> 8);
+            row[2*i + 1] = static_cast<uint8_t>(v);
+        }
+        else
+            row[i] = static_cast<uint8_t>(v);
+    }
+
+    /* Handles every per-pixel conversion except demosaicing and YUV: */
+    template <int SrcBytes, int OutBytes>
+    void convert_row(const uint8_t *src, const int width, const Convert_kind kind,
+                     const uint16_t *lut, uint8_t *dst)
+    {
+        switch (kind)
+        {
+            case CONVERT_GRAY_TO_RGB:
+                for (int x = 0; x < width; ++x)
+                {
+                    int v = read_component<SrcBytes, OutBytes>(src, x, lut);
+                    write_component<OutBytes>(dst, 3*x, v);
+                    write_component<OutBytes>(dst, 3*x + 1, v);
+                    write_component<OutBytes>(dst, 3*x + 2, v);
+                }
+                break;
+            case CONVERT_RGB_TO_GRAY:
+                /* BT.601 luma, with weights in Q8: */
+                for (int x = 0; x < width; ++x)
+                {
+                    int r = read_component<SrcBytes, OutBytes>(src, 3*x, lut);
+                    int g = read_component<SrcBytes, OutBytes>(src, 3*x + 1, lut);
+                    int b = read_component<SrcBytes, OutBytes>(src, 3*x + 2, lut);
+                    write_component<OutBytes>(dst, x, (77*r + 150*g + 29*b + 128) >> 8);
+                }
+                break;
+            case CONVERT_SWAP_RB:
+                for (int x = 0; x < width; ++x)
+                {
+                    int r = read_component<SrcBytes, OutBytes>(src, 3*x, lut);
+                    write_component<OutBytes>(dst, 3*x, read_component<SrcBytes, OutBytes>(src, 3*x + 2, lut));
+                    write_component<OutBytes>(dst, 3*x + 1, read_component<SrcBytes, OutBytes>(src, 3*x + 1, lut));
+                    write_component<OutBytes>(dst, 3*x + 2, r);
+                }
+                break;
+            default:  /* Done in convert_rows().*/
+                break;
+        }
+    }
+}
+
+int camwire::kernels::convert_rows(const uint8_t *src, const size_t src_stride, const int width, const int height,
+                                   const Camwire_pixel coding, const Camwire_tiling tiling,
+                                   uint8_t *dst, const size_t dst_stride, const int dst_first_row,
+                                   const Camwire_output output,
+                                   const Camwire_demosaic method, const uint16_t lut[256],
+                                   const int row_begin, const int row_end)
+{
+    int channels = 0, src_bytes = 0;
+    const Convert_kind kind = convert_kind(coding, tiling, output, channels, src_bytes);
+    if (kind == CONVERT_NONE || width < 1 || row_begin < 0 || row_begin > row_end || row_end > height ||
+        dst_first_row > row_begin)
+        return 0;
+
+    switch (kind)
+    {
+        case CONVERT_DEMOSAIC:
+            return demosaic_strip(src, src_stride, width, height, src_bytes, tiling, dst, dst_stride,
+                                  dst_first_row, output, method, row_begin, row_end);
+        case CONVERT_YUV:
+            return yuv_strip(src, src_stride, width, coding, tiling, dst, dst_stride, dst_first_row,
+                             output, CAMWIRE_YUV_BT601, row_begin, row_end);
+        case CONVERT_COPY:
+        {
+            const size_t row_bytes = static_cast<size_t>(width)*output_bytes(output);
+            for (int y = row_begin; y < row_end; ++y)
+                memcpy(dst + (y - dst_first_row)*dst_stride, src + y*src_stride, row_bytes);
+            return 1;
+        }
+        case CONVERT_WIDEN:
+            for (int y = row_begin; y < row_end; ++y)
+                lookup_8to16(src + y*src_stride, reinterpret_cast<uint16_t *>(dst + (y - dst_first_row)*dst_stride),
+                             static_cast<size_t>(width)*channels, lut);
+            return 1;
+        case CONVERT_NARROW:
+        {
+            /* The high byte of each big-endian component: */
+            const size_t num_components = static_cast<size_t>(width)*channels;
+            for (int y = row_begin; y < row_end; ++y)
+            {
+                const uint8_t *in = src + y*src_stride;
+                uint8_t *out = dst + (y - dst_first_row)*dst_stride;
+                for (size_t i = 0; i < num_components; ++i)
+                    out[i] = in[2*i];
+            }
+            return 1;
+        }
+        default:
+            break;
+    }
+
+    const int out_bytes = (output == CAMWIRE_OUTPUT_GRAY16 || output == CAMWIRE_OUTPUT_RGB16) ? 2 : 1;
+    for (int y = row_begin; y < row_end; ++y)
+    {
+        const uint8_t *in = src + y*src_stride;
+        uint8_t *out = dst + (y - dst_first_row)*dst_stride;
+        if (src_bytes == 1 && out_bytes == 1)
+            convert_row<1, 1>(in, width, kind, lut, out);
+        else if (src_bytes == 1)
+            convert_row<1, 2>(in, width, kind, lut, out);
+        else if (out_bytes == 1)
+            convert_row<2, 1>(in, width, kind, lut, out);
+        else
+            convert_row<2, 2>(in, width, kind, lut, out);
+    }
+    return 1;
+}
+
+namespace
+{
+    typedef void (*Colour_row_fn)(uint8_t *, const int, const int, const int32_t *);
+
+    /* coef is in the order the components are stored: */
+    template <int Bytes>
+    void colour_correct_row_scalar(uint8_t *row, const int width, const int32_t *coef)
+    {
+        const int32_t max_val = (Bytes == 1 ? 0xff : 0xffff);
+        for (int x = 0; x < width; ++x)
+        {
+            uint8_t *pixel = row + 3*Bytes*x;
+            const int32_t c0 = load_sample<Bytes>(pixel, 0);
+            const int32_t c1 = load_sample<Bytes>(pixel, 1);
+            const int32_t c2 = load_sample<Bytes>(pixel, 2);
+            for (int i = 0; i < 3; ++i)
+            {
+                int32_t v = (coef[3*i]*c0 + coef[3*i + 1]*c1 + coef[3*i + 2]*c2 + 512) >> 10;
+                store_sample<Bytes, Bytes>(pixel + i*Bytes, clamp_sample(v, max_val));
+            }
+        }
+    }
+
+    void colour_correct_row_scalar_any(uint8_t *row, const int width, const int component_bytes, const int32_t *coef)
+    {
+        if (component_bytes == 2)
+            colour_correct_row_scalar<2>(row, width, coef);
+        else
+            colour_correct_row_scalar<1>(row, width, coef);
+    }
+
+#ifdef CAMWIRE_X86_DISPATCH
+    /* Each 128-bit lane takes 12 bytes, four 8-bit or two 16-bit pixels,
+       spread out to 32-bit words by pshufb.  The lanes are loaded and
+       stored 16 bytes at a time, and the last 4 bytes of each store are
+       the bytes that were loaded there, so working in place is safe: */
+    __attribute__((target("avx2")))
+    void colour_correct_row_avx2(uint8_t *row, const int width, const int component_bytes, const int32_t *coef)
+    {
+        const int wide = (component_bytes == 2);
+        const int lane_pixels = wide ? 2 : 4;
+        const size_t row_bytes = static_cast<size_t>(width)*3*component_bytes;
+        __m256i spread[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            int8_t mask[16];
+            for (int b = 0; b < 16; ++b)
+                mask[b] = -128;
+            for (int p = 0; p < lane_pixels; ++p)
+            {
+                if (wide)
+                {
+                    mask[4*p] = static_cast<int8_t>(6*p + 2*c + 1);   /* Big-endian.*/
+                    mask[4*p + 1] = static_cast<int8_t>(6*p + 2*c);
+                }
+                else
+                    mask[4*p] = static_cast<int8_t>(3*p + c);
+            }
+            spread[c] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(mask)));
+        }
+        __m256i gather_rg, gather_b;
+        {
+            /* After packing, 8-bit results are R0-3 G0-3 B0-3 B0-3 and
+               16-bit results are R0 R1 0 0 G0 G1 0 0 in one register and
+               B0 B1 0 0 B0 B1 0 0 in another: */
+            int8_t rg[16], b[16];
+            for (int i = 0; i < 16; ++i)
+                rg[i] = b[i] = -128;
+            for (int p = 0; p < lane_pixels; ++p)
+            {
+                if (wide)
+                {
+                    rg[6*p] = static_cast<int8_t>(2*p + 1);
+                    rg[6*p + 1] = static_cast<int8_t>(2*p);
+                    rg[6*p + 2] = static_cast<int8_t>(8 + 2*p + 1);
+                    rg[6*p + 3] = static_cast<int8_t>(8 + 2*p);
+                    b[6*p + 4] = static_cast<int8_t>(2*p + 1);
+                    b[6*p + 5] = static_cast<int8_t>(2*p);
+                }
+                else
+                {
+                    rg[3*p] = static_cast<int8_t>(p);
+                    rg[3*p + 1] = static_cast<int8_t>(4 + p);
+                    rg[3*p + 2] = static_cast<int8_t>(8 + p);
+                }
+            }
+            gather_rg = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rg)));
+            gather_b = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b)));
+        }
+        __m256i k[9];
+        for (int i = 0; i < 9; ++i)
+            k[i] = _mm256_set1_epi32(coef[i]);
+        const __m256i half = _mm256_set1_epi32(512);
+
+        size_t offset = 0;
+        int x = 0;
+        for (; offset + 12 + 16 <= row_bytes; offset += 24, x += 2*lane_pixels)
+        {
+            uint8_t *p = row + offset;
+            __m256i raw = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 12)), 1);
+            __m256i c0 = _mm256_shuffle_epi8(raw, spread[0]);
+            __m256i c1 = _mm256_shuffle_epi8(raw, spread[1]);
+            __m256i c2 = _mm256_shuffle_epi8(raw, spread[2]);
+            __m256i out[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(k[3*i], c0), _mm256_mullo_epi32(k[3*i + 1], c1));
+                sum = _mm256_add_epi32(sum, _mm256_add_epi32(_mm256_mullo_epi32(k[3*i + 2], c2), half));
+                out[i] = _mm256_srai_epi32(sum, 10);
+            }
+            /* packus clamps exactly as clamp_sample() does: */
+            __m256i rg16 = _mm256_packus_epi32(out[0], out[1]);
+            __m256i b16 = _mm256_packus_epi32(out[2], out[2]);
+            __m256i packed;
+            if (wide)
+                packed = _mm256_or_si256(_mm256_shuffle_epi8(rg16, gather_rg), _mm256_shuffle_epi8(b16, gather_b));
+            else
+                packed = _mm256_shuffle_epi8(_mm256_packus_epi16(rg16, b16), gather_rg);
+            packed = _mm256_blend_epi32(packed, raw, 0x88);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm256_castsi256_si128(packed));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p + 12), _mm256_extracti128_si256(packed, 1));
+        }
+        colour_correct_row_scalar_any(row + offset, width - x, component_bytes, coef);
+    }
+#endif
+
+    struct Colour_row_impl
+    {
+        Colour_row_fn fn;
+        const char *isa;
+    };
+
+    Colour_row_impl select_colour_row()
+    {
+        Colour_row_impl impl = {colour_correct_row_scalar_any, "scalar"};
+#ifdef CAMWIRE_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            impl.fn = colour_correct_row_avx2;
+            impl.isa = "avx2";
+        }
+#endif
+        return impl;
+    }
+
+    const Colour_row_impl & colour_row_impl()
+    {
+        static const Colour_row_impl impl = select_colour_row();
+        return impl;
+    }
+}
+
+void camwire::kernels::colour_correct_rows(uint8_t *buf, const size_t stride, const int width, const int component_bytes,
+                                           const bool bgr, const int32_t coef[9], const int row_begin, const int row_end)
+{
+    /* Reorder the matrix to the order the components are stored in: */
+    int32_t stored[9];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            stored[3*i + j] = bgr ? coef[3*(2 - i) + 2 - j] : coef[3*i + j];
+    Colour_row_fn row_fn = colour_row_impl().fn;
+    for (int y = row_begin; y < row_end; ++y)
+        row_fn(buf + y*stride, width, component_bytes, stored);
+}
+
+const char * camwire::kernels::colour_correct_isa()
+{
+    return colour_row_impl().isa;
+}
+
+namespace
+{
+    typedef void (*Bin_row_fn)(const uint8_t *, const size_t, const int, const int, const int, uint8_t *);
+
+    /* Interleaved images: channels components per pixel, and colours
+       repeating every period pixels in both directions, 2 for Bayer.  A
+       block takes factor pixels of the same colour in each direction,
+       from the source row row and the rows row_step bytes apart below
+       it.  out_width is a multiple of period: */
+    template <int Bytes>
+    void reduce_row_interleaved(const uint8_t *row, const size_t row_step, const int out_width,
+                                const int channels, const int period, const int factor,
+                                const bool bin, uint8_t *dst)
+    {
+        const int shift = (factor == 2 ? 2 : 4);  /* Log2 of the block size.*/
+        const int pixel_step = period*channels;
+        for (int ox = 0; ox < out_width; ox += period)
+        {
+            const int sx = ox*factor;
+            for (int k = 0; k < period*channels; ++k)
+            {
+                const int first = sx*channels + k;
+                int v;
+                if (bin)
+                {
+                    int sum = 0;
+                    const uint8_t *block_row = row;
+                    for (int j = 0; j < factor; ++j, block_row += row_step)
+                        for (int i = 0; i < factor; ++i)
+                            sum += load_sample<Bytes>(block_row, first + pixel_step*i);
+                    v = (sum + (1 << (shift - 1))) >> shift;
+                }
+                else
+                    v = load_sample<Bytes>(row, first);
+                store_sample<Bytes, Bytes>(dst + (ox*channels + k)*Bytes, v);
+            }
+        }
+    }
+
+    /* YUV: luma is reduced per pixel and chroma per group, over the
+       groups the output group covers: */
+    void reduce_row_yuv(const uint8_t *src, const size_t src_stride, const int out_width,
+                        const Yuv_layout &layout, const int factor, const bool bin,
+                        const int oy, uint8_t *dst)
+    {
+        const int gp = layout.group_pixels, gb = layout.group_bytes;
+        const int rows = bin ? factor : 1, cols = bin ? factor : 1;
+        const int count = rows*cols;
+        for (int og = 0; og < out_width/gp; ++og)
+        {
+            uint8_t *out = dst + og*gb;
+            for (int p = 0; p < gp; ++p)
+            {
+                const int sx = (og*gp + p)*factor;
+                int sum = 0;
+                for (int j = 0; j < rows; ++j)
+                {
+                    const uint8_t *row = src + (oy*factor + j)*src_stride;
+                    for (int i = 0; i < cols; ++i)
+                        sum += row[((sx + i)/gp)*gb + layout.y[(sx + i) % gp]];
+                }
+                out[layout.y[p]] = static_cast<uint8_t>((sum + count/2)/count);
+            }
+            int u = 0, v = 0;
+            for (int j = 0; j < rows; ++j)
+            {
+                const uint8_t *row = src + (oy*factor + j)*src_stride;
+                for (int i = 0; i < cols; ++i)
+                {
+                    const uint8_t *group = row + (og*factor + i)*gb;
+                    u += group[layout.u];
+                    v += group[layout.v];
+                }
+            }
+            out[layout.u] = static_cast<uint8_t>((u + count/2)/count);
+            out[layout.v] = static_cast<uint8_t>((v + count/2)/count);
+        }
+    }
+
+    void bin8_row_scalar(const uint8_t *row, const size_t row_step, const int out_width,
+                         const int period, const int factor, uint8_t *dst)
+    {
+        reduce_row_interleaved<1>(row, row_step, out_width, 1, period, factor, true, dst);
+    }
+
+    void bin16_row_scalar(const uint8_t *row, const size_t row_step, const int out_width,
+                          const int period, const int factor, uint8_t *dst)
+    {
+        reduce_row_interleaved<2>(row, row_step, out_width, 1, period, factor, true, dst);
+    }
+
+#ifdef CAMWIRE_X86_DISPATCH
+    /* pmaddubsw against ones adds horizontal pairs, the rows are added
+       as 16-bit words and, for 4x4, pmaddwd adds the pairs of pairs.
+       Bayer rows are first sorted by colour within each block with
+       pshufb, so that the pairs added are of the same colour: */
+    __attribute__((target("avx2")))
+    void bin8_row_avx2(const uint8_t *row, const size_t row_step, const int out_width,
+                       const int period, const int factor, uint8_t *dst)
+    {
+        const __m256i ones8 = _mm256_set1_epi8(1);
+        const __m256i by_colour = (factor == 2 ?
+            _mm256_setr_epi8(0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15,
+                             0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15) :
+            _mm256_setr_epi8(0, 2, 4, 6, 1, 3, 5, 7, 8, 10, 12, 14, 9, 11, 13, 15,
+                             0, 2, 4, 6, 1, 3, 5, 7, 8, 10, 12, 14, 9, 11, 13, 15));
+        int ox = 0;
+        if (factor == 2)
+        {
+            const __m256i round = _mm256_set1_epi16(2);
+            for (; ox + 32 <= out_width; ox += 32)
+            {
+                __m256i sums[2];
+                for (int h = 0; h < 2; ++h)
+                {
+                    const uint8_t *p = row + 2*ox + 32*h;
+                    __m256i top = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                    __m256i bottom = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + row_step));
+                    if (period == 2)
+                    {
+                        top = _mm256_shuffle_epi8(top, by_colour);
+                        bottom = _mm256_shuffle_epi8(bottom, by_colour);
+                    }
+                    sums[h] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_maddubs_epi16(top, ones8),
+                                                                                  _mm256_maddubs_epi16(bottom, ones8)),
+                                                                 round), 2);
+                }
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums[0], sums[1]), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + ox), packed);
+            }
+        }
+        else
+        {
+            const __m256i ones16 = _mm256_set1_epi16(1);
+            const __m256i round = _mm256_set1_epi32(8);
+            for (; ox + 16 <= out_width; ox += 16)
+            {
+                __m256i sums[2];
+                for (int h = 0; h < 2; ++h)
+                {
+                    const uint8_t *p = row + 4*ox + 32*h;
+                    __m256i pairs = _mm256_setzero_si256();
+                    for (int j = 0; j < 4; ++j)
+                    {
+                        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + j*row_step));
+                        if (period == 2)
+                            v = _mm256_shuffle_epi8(v, by_colour);
+                        pairs = _mm256_add_epi16(pairs, _mm256_maddubs_epi16(v, ones8));
+                    }
+                    sums[h] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(pairs, ones16), round), 4);
+                }
+                __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(sums[0], sums[1]), _MM_SHUFFLE(3, 1, 2, 0));
+                __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ox), _mm256_castsi256_si128(bytes));
+            }
+        }
+        bin8_row_scalar(row + factor*ox, row_step, out_width - ox, period, factor, dst + ox);
+    }
+
+    /* Big-endian 16-bit samples: two pshufb masks each pick four samples
+       of a 128-bit lane as host order 32-bit words, chosen so that adding
+       the two gives the sums of same-colour pairs (2x2) or, after a
+       horizontal add, of same-colour quads (4x4): */
+    __attribute__((target("avx2")))
+    void bin16_row_avx2(const uint8_t *row, const size_t row_step, const int out_width,
+                        const int period, const int factor, uint8_t *dst)
+    {
+        static const int picks[2][2][2][4] = {
+            {{{0, 2, 4, 6}, {1, 3, 5, 7}}, {{0, 1, 4, 5}, {2, 3, 6, 7}}},   /* 2x2, mono and Bayer.*/
+            {{{0, 1, 4, 5}, {2, 3, 6, 7}}, {{0, 2, 1, 3}, {4, 6, 5, 7}}}};  /* 4x4, mono and Bayer.*/
+        int8_t mask_bytes[2][16];
+        for (int m = 0; m < 2; ++m)
+            for (int d = 0; d < 4; ++d)
+            {
+                const int sample = picks[factor == 4][period == 2][m][d];
+                mask_bytes[m][4*d] = static_cast<int8_t>(2*sample + 1);
+                mask_bytes[m][4*d + 1] = static_cast<int8_t>(2*sample);
+                mask_bytes[m][4*d + 2] = mask_bytes[m][4*d + 3] = -128;  /* Zero.*/
+            }
+        const __m256i pick_a = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(mask_bytes[0])));
+        const __m256i pick_b = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(mask_bytes[1])));
+        const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                              1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+        const int out_step = (factor == 2 ? 16 : 8);
+        const __m256i round = _mm256_set1_epi32(factor == 2 ? 2 : 8);
+        const __m128i shift = _mm_cvtsi32_si128(factor == 2 ? 2 : 4);
+        int ox = 0;
+        for (; ox + out_step <= out_width; ox += out_step)
+        {
+            __m256i sums[2];
+            for (int h = 0; h < 2; ++h)
+            {
+                const uint8_t *p = row + 2*factor*ox + 32*h;
+                sums[h] = _mm256_setzero_si256();
+                for (int j = 0; j < factor; ++j)
+                {
+                    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + j*row_step));
+                    sums[h] = _mm256_add_epi32(sums[h], _mm256_add_epi32(_mm256_shuffle_epi8(v, pick_a),
+                                                                         _mm256_shuffle_epi8(v, pick_b)));
+                }
+            }
+            if (factor == 2)
+            {
+                for (int h = 0; h < 2; ++h)
+                    sums[h] = _mm256_srl_epi32(_mm256_add_epi32(sums[h], round), shift);
+                __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(sums[0], sums[1]), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2*ox), _mm256_shuffle_epi8(words, swap));
+            }
+            else
+            {
+                __m256i quads = _mm256_permute4x64_epi64(_mm256_hadd_epi32(sums[0], sums[1]), _MM_SHUFFLE(3, 1, 2, 0));
+                quads = _mm256_srl_epi32(_mm256_add_epi32(quads, round), shift);
+                __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(quads, quads), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2*ox),
+                                 _mm256_castsi256_si128(_mm256_shuffle_epi8(words, swap)));
+            }
+        }
+        bin16_row_scalar(row + 2*factor*ox, row_step, out_width - ox, period, factor, dst + 2*ox);
+    }
+#endif
+
+    struct Bin_row_impl
+    {
+        Bin_row_fn bin8;
+        Bin_row_fn bin16;
+        const char *isa;
+    };
+
+    Bin_row_impl select_bin_row()
+    {
+        Bin_row_impl impl = {bin8_row_scalar, bin16_row_scalar, "scalar"};
+#ifdef CAMWIRE_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            impl.bin8 = bin8_row_avx2;
+            impl.bin16 = bin16_row_avx2;
+            impl.isa = "avx2";
+        }
+#endif
+        return impl;
+    }
+
+    const Bin_row_impl & bin_row_impl()
+    {
+        static const Bin_row_impl impl = select_bin_row();
+        return impl;
+    }
+
+    /* Channels, bytes per component and colour period of the codings that
+       are reduced pixel by pixel.  Returns 0 for other codings: */
+    int interleaved_layout(const camwire::Camwire_pixel coding, const camwire::Camwire_tiling tiling,
+                           int &channels, int &bytes, int &period)
+    {
+        using namespace camwire;
+        switch (coding)
+        {
+            case CAMWIRE_PIXEL_MONO8:
+            case CAMWIRE_PIXEL_RAW8:     channels = 1;  bytes = 1;  break;
+            case CAMWIRE_PIXEL_MONO16:
+            case CAMWIRE_PIXEL_RAW16:    channels = 1;  bytes = 2;  break;
+            case CAMWIRE_PIXEL_RGB8:     channels = 3;  bytes = 1;  break;
+            case CAMWIRE_PIXEL_RGB16:    channels = 3;  bytes = 2;  break;
+            default:                     return 0;
+        }
+        period = (channels == 1 && is_bayer(tiling)) ? 2 : 1;
+        return 1;
+    }
+}
+
+int camwire::kernels::reduced_size(const int width, const int height, const Camwire_pixel coding,
+                                   const Camwire_tiling tiling, const int factor, int &out_width, int &out_height)
+{
+    if (factor != 2 && factor != 4)
+        return 0;
+    int channels, bytes, period;
+    if (interleaved_layout(coding, tiling, channels, bytes, period))
+    {
+        out_width = width/(period*factor)*period;
+        out_height = height/(period*factor)*period;
+        return 1;
+    }
+    const Yuv_layout *layout = yuv_layout(coding, tiling);
+    if (!layout)
+        return 0;
+    out_width = width/(layout->group_pixels*factor)*layout->group_pixels;
+    out_height = height/factor;
+    return 1;
+}
+
+int camwire::kernels::reduce_rows(const uint8_t *src, const size_t src_stride, const int width, const int height,
+                                  const Camwire_pixel coding, const Camwire_tiling tiling, const int factor,
+                                  const Camwire_reduction method, uint8_t *dst, const size_t dst_stride,
+                                  const int row_begin, const int row_end)
+{
+    int out_width, out_height;
+    if (!reduced_size(width, height, coding, tiling, factor, out_width, out_height))
+        return 0;
+    if (row_begin < 0 || row_begin > row_end || row_end > out_height)
+        return 0;
+
+    const bool bin = (method == CAMWIRE_REDUCE_BIN);
+    int channels, bytes, period;
+    if (interleaved_layout(coding, tiling, channels, bytes, period))
+    {
+        const size_t row_step = period*src_stride;
+        for (int y = row_begin; y < row_end; ++y)
+        {
+            const uint8_t *row = src + ((y/period)*period*factor + y % period)*src_stride;
+            uint8_t *out_row = dst + y*dst_stride;
+            if (bin && channels == 1)
+                (bytes == 2 ? bin_row_impl().bin16 : bin_row_impl().bin8)(row, row_step, out_width, period,
+                                                                         factor, out_row);
+            else if (bytes == 2)
+                reduce_row_interleaved<2>(row, row_step, out_width, channels, period, factor, bin, out_row);
+            else
+                reduce_row_interleaved<1>(row, row_step, out_width, channels, period, factor, bin, out_row);
+        }
+        return 1;
+    }
+
+    const Yuv_layout *layout = yuv_layout(coding, tiling);
+    for (int y = row_begin; y < row_end; ++y)
+        reduce_row_yuv(src, src_stride, out_width, *layout, factor, bin, y, dst + y*dst_stride);
+    return 1;
+}
+
+const char * camwire::kernels::reduce_isa()
+{
+    return bin_row_impl().isa;
+}
+
+namespace
+{
+    /* Histogram counts are spread over several tables so that runs of
+       equal samples do not wait on each other's increments: */
+    const int HISTOGRAM_TABLES = 4;
+
+    struct Stats_accumulator
+    {
+        uint32_t histogram[HISTOGRAM_TABLES][256];
+        uint64_t sum;
+        int min, max;
+        int64_t samples;
+    };
+
+    typedef void (*Stats16_run_fn)(const uint8_t *, const int, Stats_accumulator &);
+
+    void stats8_run(const uint8_t *src, const int num_samples, Stats_accumulator &acc)
+    {
+        int k = 0;
+        for (; k + HISTOGRAM_TABLES <= num_samples; k += HISTOGRAM_TABLES)
+            for (int t = 0; t < HISTOGRAM_TABLES; ++t)
+                ++acc.histogram[t][src[k + t]];
+        for (; k < num_samples; ++k)
+            ++acc.histogram[0][src[k]];
+        acc.samples += num_samples;
+    }
+
+    /* Contiguous big-endian 16-bit samples: */
+    void stats16_run_scalar(const uint8_t *src, const int num_samples, Stats_accumulator &acc)
+    {
+        for (int k = 0; k < num_samples; ++k)
+        {
+            const int v = load_sample<2>(src, k);
+            acc.sum += v;
+            if (v < acc.min)  acc.min = v;
+            if (v > acc.max)  acc.max = v;
+            ++acc.histogram[k % HISTOGRAM_TABLES][src[2*k]];
+        }
+        acc.samples += num_samples;
+    }
+
+#ifdef CAMWIRE_X86_DISPATCH
+    __attribute__((target("avx2")))
+    void stats16_run_avx2(const uint8_t *src, const int num_samples, Stats_accumulator &acc)
+    {
+        const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                              1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i vmin = _mm256_set1_epi16(-1), vmax = zero, vsum = zero;
+        int k = 0;
+        for (; k + 16 <= num_samples; k += 16)
+        {
+            const uint8_t *p = src + 2*k;
+            __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), swap);
+            vmin = _mm256_min_epu16(vmin, v);
+            vmax = _mm256_max_epu16(vmax, v);
+            __m256i pairs = _mm256_add_epi32(_mm256_unpacklo_epi16(v, zero), _mm256_unpackhi_epi16(v, zero));
+            vsum = _mm256_add_epi64(vsum, _mm256_add_epi64(_mm256_unpacklo_epi32(pairs, zero),
+                                                           _mm256_unpackhi_epi32(pairs, zero)));
+            for (int i = 0; i < 16; i += HISTOGRAM_TABLES)
+                for (int t = 0; t < HISTOGRAM_TABLES; ++t)
+                    ++acc.histogram[t][p[2*(i + t)]];
+        }
+        uint16_t mins[16], maxs[16];
+        uint64_t sums[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(mins), vmin);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(maxs), vmax);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums), vsum);
+        if (k > 0)
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                if (mins[i] < acc.min)  acc.min = mins[i];
+                if (maxs[i] > acc.max)  acc.max = maxs[i];
+            }
+            acc.sum += sums[0] + sums[1] + sums[2] + sums[3];
+            acc.samples += k;
+        }
+        stats16_run_scalar(src + 2*k, num_samples - k, acc);
+    }
+#endif
+
+    struct Stats16_run_impl
+    {
+        Stats16_run_fn fn;
+        const char *isa;
+    };
+
+    Stats16_run_impl select_stats16_run()
+    {
+        Stats16_run_impl impl = {stats16_run_scalar, "scalar"};
+#ifdef CAMWIRE_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            impl.fn = stats16_run_avx2;
+            impl.isa = "avx2";
+        }
+#endif
+        return impl;
+    }
+
+    const Stats16_run_impl & stats16_run_impl()
+    {
+        static const Stats16_run_impl impl = select_stats16_run();
+        return impl;
+    }
+}
+
+int camwire::kernels::image_stats(const uint8_t *src, const size_t src_stride, const int width,
+                                  const Camwire_pixel coding, const Camwire_tiling tiling,
+                                  const int left, const int top, const int roi_width, const int roi_height,
+                                  const int step, Camwire_image_stats &stats)
+{
+    Stats_sums sums;
+    if (!image_stats_rows(src, src_stride, width, coding, tiling, left, top, roi_width, roi_height,
+                          step, top, top + roi_height, sums))
+        return 0;
+    return finish_image_stats(sums, stats);
+}
+
+int camwire::kernels::image_stats_rows(const uint8_t *src, const size_t src_stride, const int width,
+                                       const Camwire_pixel coding, const Camwire_tiling tiling,
+                                       const int left, const int top, const int roi_width, const int roi_height,
+                                       const int step, const int row_begin, const int row_end, Stats_sums &sums)
+{
+    int channels = 1, bytes = 1, period = 1;
+    const Yuv_layout *layout = 0;
+    if (!interleaved_layout(coding, tiling, channels, bytes, period))
+    {
+        layout = yuv_layout(coding, tiling);
+        if (!layout)
+            return 0;
+    }
+    if (step < 1 || left < 0 || top < 0 || roi_width <= 0 || roi_height <= 0 || left + roi_width > width)
+        return 0;
+
+    Stats_accumulator acc;
+    std::memset(acc.histogram, 0, sizeof(acc.histogram));
+    acc.sum = 0;
+    acc.min = 65535;
+    acc.max = 0;
+    acc.samples = 0;
+    Stats16_run_fn run16 = stats16_run_impl().fn;
+
+    /* Steps are taken in whole colour periods, so that a Bayer grid keeps
+       all four colours.  They count from the top of the region, whatever
+       rows are measured now: */
+    const int dy_end = std::min(roi_height, row_end - top);
+    for (int dy = std::max(0, row_begin - top); dy < dy_end; ++dy)
+    {
+        if ((dy/period) % step != 0)
+            continue;
+        const uint8_t *row = src + (top + dy)*src_stride;
+        if (layout)
+        {
+            for (int dx = 0; dx < roi_width; dx += step)
+            {
+                const int x = left + dx;
+                stats8_run(row + (x/layout->group_pixels)*layout->group_bytes + layout->y[x % layout->group_pixels],
+                           1, acc);
+            }
+        }
+        else if (step == 1)
+        {
+            const uint8_t *run = row + left*channels*bytes;
+            if (bytes == 2)
+                run16(run, roi_width*channels, acc);
+            else
+                stats8_run(run, roi_width*channels, acc);
+        }
+        else
+        {
+            for (int dx = 0; dx < roi_width; dx += period*step)
+            {
+                const int tile = (roi_width - dx < period) ? roi_width - dx : period;
+                const uint8_t *run = row + (left + dx)*channels*bytes;
+                if (bytes == 2)
+                    stats16_run_scalar(run, tile*channels, acc);
+                else
+                    stats8_run(run, tile*channels, acc);
+            }
+        }
+    }
+
+    for (int b = 0; b < 256; ++b)
+        for (int t = 0; t < HISTOGRAM_TABLES; ++t)
+            sums.histogram[b] += acc.histogram[t][b];
+    /* 8-bit samples are fully described by their histogram, so only
+       16-bit ones are summed: */
+    if (bytes == 2 && acc.samples > 0)
+    {
+        sums.sum += acc.sum;
+        sums.min = std::min(sums.min, acc.min);
+        sums.max = std::max(sums.max, acc.max);
+    }
+    sums.samples += acc.samples;
+    sums.full_scale = (bytes == 2) ? 65535 : 255;
+    return 1;
+}
+
+int camwire::kernels::finish_image_stats(const Stats_sums &sums, Camwire_image_stats &stats)
+{
+    if (sums.samples == 0)
+        return 0;
+    uint64_t sum = sums.sum;
+    int min = sums.min, max = sums.max;
+    if (sums.full_scale == 255)
+    {
+        sum = 0;
+        min = 255;
+        max = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            if (sums.histogram[b])
+            {
+                if (b < min)  min = b;
+                max = b;
+                sum += static_cast<uint64_t>(b)*sums.histogram[b];
+            }
+        }
+    }
+    std::copy(sums.histogram, sums.histogram + 256, stats.histogram);
+    stats.samples = sums.samples;
+    stats.mean = static_cast<double>(sum)/sums.samples;
+    stats.min = min;
+    stats.max = max;
+    stats.full_scale = sums.full_scale;
+    stats.clipped = sums.histogram[255];
+    return 1;
+}
+
+const char * camwire::kernels::image_stats_isa()
+{
+    return stats16_run_impl().isa;
+}
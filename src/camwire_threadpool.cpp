@@ -0,0 +1,100 @@
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+    Title: Camwire thread pool
+
+    Description:
+    Tasks are handed out through one atomic counter, so the threads take
+    the next index as soon as they are free and uneven tasks balance out
+    on their own.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+#include <camwire_threadpool.hpp>
+
+camwire::camwirethreadpool::camwirethreadpool(const int num_threads):
+    job(0), job_size(0), next_task(0), busy_workers(0), generation(0), stopping(false)
+{
+    for (int t = 1; t < num_threads; ++t)
+        workers.push_back(std::thread(&camwirethreadpool::worker_loop, this, t));
+}
+
+camwire::camwirethreadpool::~camwirethreadpool()
+{
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (size_t w = 0; w < workers.size(); ++w)
+        workers[w].join();
+}
+
+void camwire::camwirethreadpool::parallel_for(const int num_tasks, const Task &task)
+{
+    if (workers.empty() || num_tasks < 2)
+    {
+        for (int i = 0; i < num_tasks; ++i)
+            task(i, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        job = &task;
+        job_size = num_tasks;
+        next_task = 0;
+        busy_workers = static_cast<int>(workers.size());
+        ++generation;
+    }
+    job_ready.notify_all();
+    run_tasks(0);
+
+    std::unique_lock<std::mutex> lock(job_mutex);
+    job_done.wait(lock, [this]{return busy_workers == 0;});
+    job = 0;
+}
+
+/* Private methods */
+
+void camwire::camwirethreadpool::worker_loop(const int thread_index)
+{
+    uint64_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(job_mutex);
+            job_ready.wait(lock, [this, seen]{return stopping || generation != seen;});
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        run_tasks(thread_index);
+        std::lock_guard<std::mutex> lock(job_mutex);
+        if (--busy_workers == 0)
+            job_done.notify_one();
+    }
+}
+
+void camwire::camwirethreadpool::run_tasks(const int thread_index)
+{
+    int i;
+    while ((i = next_task++) < job_size)
+        (*job)(i, thread_index);
+}
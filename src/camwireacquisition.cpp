@@ -0,0 +1,316 @@
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+
+    Title: Camera Acquisition module
+
+    Description:
+    This Acquisition module runs one dequeue thread per camera and hands
+    the frames to the application through a lock-free single-producer
+    single-consumer queue.  The mutex and condition variables are only
+    used to put an idle thread to sleep.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+#include <camwireacquisition.hpp>
+#include <chrono>
+
+/* How long the acquisition thread sleeps at a time, so that it notices
+   stop() even if no frames arrive: */
+#define ACQUISITION_IDLE_MS   100
+
+camwire::camwireacquisition::camwireacquisition():
+    running(0), failed(0), head(0), tail(0), dropped_frames(0), max_held(0),
+    consumer_waiting(0), producer_waiting(0)
+{
+}
+
+camwire::camwireacquisition::~camwireacquisition()
+{
+    stop();
+}
+
+int camwire::camwireacquisition::start(const std::shared_ptr<camwire> &camera_manager, const Camwire_bus_handle_ptr &c_handle, const int queue_size)
+{
+    try
+    {
+        ERROR_IF_NULL(camera_manager);
+        ERROR_IF_NULL(c_handle);
+        if (running || worker.joinable())
+        {
+            DPRINTF("Acquisition thread already started.");
+            return CAMWIRE_FAILURE;
+        }
+
+        int num_frame_buffers;
+        ERROR_IF_CAMWIRE_FAIL(camera_manager->get_num_framebuffers(c_handle, num_frame_buffers));
+        max_held = num_frame_buffers - 1;
+        int capacity = queue_size > 0 ? queue_size : num_frame_buffers - 2;
+        if (capacity < 1 || capacity > max_held)
+        {
+            DPRINTF("Queue size must be between 1 and get_num_framebuffers() - 1.");
+            return CAMWIRE_FAILURE;
+        }
+
+        cam = camera_manager;
+        handle = c_handle;
+        ring.assign(capacity + 1, Queued_frame());
+        popped.clear();
+        popped.reserve(max_held);
+        head = 0;
+        tail = 0;
+        dropped_frames = 0;
+        failed = 0;
+        running = 1;
+        worker = std::thread(&camwireacquisition::run, this);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        running = 0;
+        DPRINTF("Failed to start acquisition");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwireacquisition::stop()
+{
+    try
+    {
+        running = 0;
+        if (worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(wait_mutex);
+                frame_released.notify_all();
+            }
+            worker.join();
+        }
+
+        /* Give back whatever the consumer did not get to: */
+        Queued_frame entry;
+        while (cam && pop(entry))
+            cam->release_frame(handle, entry.buffer, entry.generation);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to stop acquisition");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwireacquisition::is_running()
+{
+    return running;
+}
+
+int camwire::camwireacquisition::try_pop(void **buf_ptr, int &buffer_lag)
+{
+    ERROR_IF_NULL(buf_ptr);
+    Queued_frame entry;
+    if (pop(entry))
+    {
+        {
+            std::lock_guard<std::mutex> lock(popped_mutex);
+            popped.push_back(entry);
+        }
+        *buf_ptr = entry.buffer;
+        buffer_lag = entry.buffer_lag;
+    }
+    else
+    {
+        *buf_ptr = 0;
+        buffer_lag = 0;
+        if (failed)
+        {
+            DPRINTF("Acquisition thread stopped because it could not dequeue a frame.");
+            return CAMWIRE_FAILURE;
+        }
+    }
+    return CAMWIRE_SUCCESS;
+}
+
+int camwire::camwireacquisition::pop_for(void **buf_ptr, int &buffer_lag, const double timeout)
+{
+    try
+    {
+        ERROR_IF_NULL(buf_ptr);
+        ERROR_IF_CAMWIRE_FAIL(try_pop(buf_ptr, buffer_lag));
+        if (*buf_ptr || timeout <= 0.0)
+            return CAMWIRE_SUCCESS;
+
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        consumer_waiting.store(1, std::memory_order_seq_cst);
+        /* Check again after announcing that we wait, so that a push in
+           between is not missed.  The fence pairs with the one in run()
+           after push(): either we see the new tail or the producer sees
+           consumer_waiting set and notifies: */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (head.load(std::memory_order_relaxed) == tail.load(std::memory_order_seq_cst) && !failed)
+        {
+            if (frame_ready.wait_until(lock, deadline) == std::cv_status::timeout)
+                break;
+        }
+        consumer_waiting = 0;
+        lock.unlock();
+        return try_pop(buf_ptr, buffer_lag);
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to pop frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwireacquisition::release(const void *buf_ptr)
+{
+    try
+    {
+        ERROR_IF_NULL(cam);
+        Queued_frame entry;
+        {
+            std::lock_guard<std::mutex> lock(popped_mutex);
+            std::vector<Queued_frame>::iterator found = popped.begin();
+            while (found != popped.end() && found->buffer != buf_ptr)
+                ++found;
+            if (found == popped.end())
+            {
+                DPRINTF("Buffer was not popped from the acquisition queue.");
+                return CAMWIRE_FAILURE;
+            }
+            entry = *found;
+            popped.erase(found);
+        }
+        ERROR_IF_CAMWIRE_FAIL(cam->release_frame(handle, entry.buffer, entry.generation));
+        /* Pairs with the fence in wait_for_room(): */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producer_waiting.load(std::memory_order_seq_cst))
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            frame_released.notify_one();
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to release frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwireacquisition::get_num_dropped(int64_t &dropped)
+{
+    dropped = dropped_frames;
+    return CAMWIRE_SUCCESS;
+}
+
+/* Private methods */
+
+void camwire::camwireacquisition::run()
+{
+    while (running)
+    {
+        /* Dequeueing would fail while the consumer holds every buffer: */
+        if (!wait_for_room(ACQUISITION_IDLE_MS*1.0e-3))
+            continue;
+
+        void *buffer = 0;
+        int buffer_lag = 0;
+        if (cam->hold_next_frame_for(handle, &buffer, buffer_lag, ACQUISITION_IDLE_MS*1.0e-3) != CAMWIRE_SUCCESS)
+        {
+            DPRINTF("Acquisition thread could not dequeue a frame.");
+            /* Let a waiting consumer fail instead of timing out: */
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            failed = 1;
+            frame_ready.notify_all();
+            break;
+        }
+        if (!buffer)
+            continue;
+
+        Queued_frame entry;
+        entry.buffer = buffer;
+        entry.buffer_lag = buffer_lag;
+        if (cam->get_frame_generation(handle, buffer, entry.generation) != CAMWIRE_SUCCESS)
+            continue;  /* Taken back already by a new DMA ring.*/
+        if (push(entry))
+        {
+            /* Pairs with the fence in pop_for(): */
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (consumer_waiting.load(std::memory_order_seq_cst))
+            {
+                std::lock_guard<std::mutex> lock(wait_mutex);
+                frame_ready.notify_one();
+            }
+        }
+        else
+        {
+            cam->release_frame(handle, buffer, entry.generation);
+            ++dropped_frames;
+        }
+    }
+    running = 0;
+}
+
+int camwire::camwireacquisition::push(const Queued_frame &entry)
+{
+    size_t current = tail.load(std::memory_order_relaxed);
+    size_t next = (current + 1) % ring.size();
+    if (next == head.load(std::memory_order_acquire))
+        return 0;  /* Full.*/
+    ring[current] = entry;
+    tail.store(next, std::memory_order_seq_cst);
+    return 1;
+}
+
+int camwire::camwireacquisition::pop(Queued_frame &entry)
+{
+    size_t current = head.load(std::memory_order_relaxed);
+    if (current == tail.load(std::memory_order_acquire))
+        return 0;  /* Empty.*/
+    entry = ring[current];
+    head.store((current + 1) % ring.size(), std::memory_order_release);
+    return 1;
+}
+
+int camwire::camwireacquisition::wait_for_room(const double timeout)
+{
+    int num_held;
+    if (cam->get_num_held_frames(handle, num_held) != CAMWIRE_SUCCESS)
+        return 0;
+    if (num_held < max_held)
+        return 1;
+
+    std::unique_lock<std::mutex> lock(wait_mutex);
+    producer_waiting.store(1, std::memory_order_seq_cst);
+    /* Pairs with the fence in release(): either we see the released
+       frame or the consumer sees producer_waiting set and notifies: */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (cam->get_num_held_frames(handle, num_held) == CAMWIRE_SUCCESS &&
+        num_held >= max_held && running)
+    {
+        frame_released.wait_for(lock, std::chrono::duration<double>(timeout));
+        cam->get_num_held_frames(handle, num_held);
+    }
+    producer_waiting = 0;
+    return num_held < max_held;
+}
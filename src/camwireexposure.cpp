@@ -0,0 +1,218 @@
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+
+    Title: Camera Exposure module
+
+    Description:
+    This Exposure module runs a controller thread per camera.  It wakes
+    up on new image statistics and works in exposure units, shutter time
+    times linear gain, so a change is split between shutter and gain
+    without the loop noticing.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+#include <camwireexposure.hpp>
+#include <algorithm>        //std::min
+#include <cmath>            //pow
+
+/* How long the controller thread waits for statistics at a time, so that
+   it notices stop() even if no frames arrive: */
+#define EXPOSURE_IDLE_MS   100
+
+/* Corrections are limited to this factor either way per write, so that
+   one odd frame cannot throw the exposure far off: */
+#define EXPOSURE_MAX_STEP  4.0
+
+/* Relative changes smaller than this are not worth a register write: */
+#define EXPOSURE_MIN_CHANGE  1.0e-3
+
+camwire::camwireexposure::camwireexposure():
+    running(0), target_level(0), num_writes(0), shutter(0), gain(0), gain_settable(0)
+{
+}
+
+camwire::camwireexposure::~camwireexposure()
+{
+    stop();
+}
+
+int camwire::camwireexposure::start(const std::shared_ptr<camwire> &camera_manager, const Camwire_bus_handle_ptr &c_handle,
+                                    const Camwire_exposure_settings &settings)
+{
+    try
+    {
+        ERROR_IF_NULL(camera_manager);
+        ERROR_IF_NULL(c_handle);
+        if (running || worker.joinable())
+        {
+            DPRINTF("Exposure controller already started.");
+            return CAMWIRE_FAILURE;
+        }
+        if (settings.target <= 0.0 || settings.target >= 1.0 || settings.deadband < 0.0 ||
+            settings.damping <= 0.0 || settings.damping > 1.0 || settings.interval < 1 ||
+            settings.min_shutter <= 0.0 || settings.max_gain < 1.0)
+        {
+            DPRINTF("Invalid exposure controller settings.");
+            return CAMWIRE_FAILURE;
+        }
+
+        config = settings;
+        if (config.max_shutter <= 0.0)
+        {
+            double frame_rate;
+            ERROR_IF_CAMWIRE_FAIL(camera_manager->get_framerate(c_handle, frame_rate));
+            ERROR_IF_ZERO(frame_rate > 0.0);
+            config.max_shutter = 1.0/frame_rate;
+        }
+        config.min_shutter = std::min(config.min_shutter, config.max_shutter);
+
+        ERROR_IF_CAMWIRE_FAIL(camera_manager->get_shutter(c_handle, shutter));
+        gain_settable = (config.max_gain > 1.0 &&
+                         camera_manager->get_gain(c_handle, gain) == CAMWIRE_SUCCESS);
+        if (!gain_settable)
+            gain = 0.0;
+        ERROR_IF_CAMWIRE_FAIL(camera_manager->set_image_stats(c_handle, 1, config.stats_step));
+
+        cam = camera_manager;
+        handle = c_handle;
+        target_level = config.target;
+        num_writes = 0;
+        running = 1;
+        worker = std::thread(&camwireexposure::run, this);
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        running = 0;
+        DPRINTF("Failed to start exposure controller");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwireexposure::stop()
+{
+    running = 0;
+    if (worker.joinable())
+        worker.join();
+    return CAMWIRE_SUCCESS;
+}
+
+int camwire::camwireexposure::is_running()
+{
+    return running;
+}
+
+int camwire::camwireexposure::set_target(const double target)
+{
+    if (target <= 0.0 || target >= 1.0)
+    {
+        DPRINTF("Target brightness must be between 0 and 1.");
+        return CAMWIRE_FAILURE;
+    }
+    target_level = target;
+    return CAMWIRE_SUCCESS;
+}
+
+int camwire::camwireexposure::get_num_writes(int64_t &writes)
+{
+    writes = num_writes;
+    return CAMWIRE_SUCCESS;
+}
+
+/* Private methods */
+
+void camwire::camwireexposure::run()
+{
+    int64_t last_frame = 0, next_frame = 0;
+    Camwire_image_stats stats;
+    while (running)
+    {
+        if (cam->wait_image_stats(handle, stats, last_frame, EXPOSURE_IDLE_MS*1.0e-3) != CAMWIRE_SUCCESS)
+        {
+            DPRINTF("Exposure controller could not get image statistics.");
+            break;
+        }
+        if (stats.frame_number <= last_frame || stats.samples == 0)
+            continue;
+        last_frame = stats.frame_number;
+
+        /* Frames already in the DMA ring were exposed before the last
+           write, so they are skipped: */
+        if (last_frame < next_frame)
+            continue;
+        double ratio = exposure_ratio(stats);
+        if (std::fabs(ratio - 1.0) <= config.deadband)
+            continue;
+        if (apply_ratio(ratio))
+            next_frame = last_frame + config.interval;
+    }
+    running = 0;
+}
+
+double camwire::camwireexposure::exposure_ratio(const Camwire_image_stats &stats)
+{
+    double level = std::max(stats.mean/stats.full_scale, 1.0/stats.full_scale);
+    double ratio = target_level/level;
+
+    /* A mean on target can still hide large burnt-out areas: */
+    if (static_cast<double>(stats.clipped)/stats.samples > config.max_clipped)
+        ratio = std::min(ratio, 1.0/(1.0 + 2.0*config.deadband));
+
+    ratio = std::pow(ratio, config.damping);
+    return std::max(1.0/EXPOSURE_MAX_STEP, std::min(ratio, EXPOSURE_MAX_STEP));
+}
+
+int camwire::camwireexposure::apply_ratio(const double ratio)
+{
+    /* Linear gain is taken to rise evenly from 1 at relative gain 0 to
+       max_gain at relative gain 1: */
+    const double slope = config.max_gain - 1.0;
+    double exposure = shutter*(1.0 + gain*slope)*ratio;
+    double new_shutter = std::max(config.min_shutter, std::min(exposure, config.max_shutter));
+    double new_gain = 0.0;
+    if (gain_settable)
+        new_gain = std::max(0.0, std::min((exposure/new_shutter - 1.0)/slope, 1.0));
+
+    int written = 0;
+    if (std::fabs(new_shutter - shutter) > EXPOSURE_MIN_CHANGE*shutter)
+    {
+        if (cam->set_shutter(handle, new_shutter) == CAMWIRE_SUCCESS)
+        {
+            cam->get_shutter(handle, shutter);
+            ++num_writes;
+            written = 1;
+        }
+    }
+    if (gain_settable && std::fabs(new_gain - gain) > EXPOSURE_MIN_CHANGE)
+    {
+        if (cam->set_gain(handle, new_gain) == CAMWIRE_SUCCESS)
+        {
+            cam->get_gain(handle, gain);
+            ++num_writes;
+            written = 1;
+        }
+        else
+        {
+            DPRINTF("Gain is not settable, exposure is controlled by the shutter only.");
+            gain_settable = 0;
+        }
+    }
+    return written;
+}
@@ -0,0 +1,275 @@
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+
+    Title: Camera Pipeline module
+
+    Description:
+    The first stage of a strip reads the frame directly, so stages that
+    need neighbouring rows, like demosaicing, see the whole frame and
+    strips need no overlap.  The later stages are per-pixel and work in
+    place on the strip.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+#include <camwirepipeline.hpp>
+#include <camwire_kernels.hpp>
+#include <camwire_threadpool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <netinet/in.h>     //htons on Linux
+
+/* Bytes of output per strip, about half of a typical L2 cache so that
+   the strip and its scratch copy both fit: */
+#define PIPELINE_STRIP_BYTES  (128*1024)
+
+camwire::camwirepipeline::camwirepipeline():
+    pool(new camwirethreadpool(1)), scratch(1), output(CAMWIRE_OUTPUT_RGB8),
+    method(CAMWIRE_DEMOSAIC_BILINEAR), crop_left(0), crop_top(0), crop_width(0),
+    crop_height(0), gamma_maxval(0), correct_colour(0)
+{
+    for (size_t i = 0; i < 256; ++i)
+        linear_lut[i] = htons(static_cast<uint16_t>(257*i));
+}
+
+camwire::camwirepipeline::~camwirepipeline()
+{
+}
+
+int camwire::camwirepipeline::set_num_threads(const int num_threads)
+{
+    try
+    {
+        if (num_threads < 1)
+        {
+            DPRINTF("Need at least one thread.");
+            return CAMWIRE_FAILURE;
+        }
+        if (num_threads != pool->size())
+        {
+            pool.reset();   /* Join the old workers first.*/
+            pool.reset(new camwirethreadpool(num_threads));
+            scratch.assign(num_threads, std::vector<uint8_t>());
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to set the number of pipeline threads");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwirepipeline::set_output(const Camwire_output output, const Camwire_demosaic method)
+{
+    if (kernels::output_bytes(output) == 0)
+    {
+        DPRINTF("Invalid output layout.");
+        return CAMWIRE_FAILURE;
+    }
+    this->output = output;
+    this->method = method;
+    return CAMWIRE_SUCCESS;
+}
+
+int camwire::camwirepipeline::set_crop(const int left, const int top, const int width, const int height)
+{
+    if (left < 0 || top < 0 || width < 0 || height < 0)
+    {
+        DPRINTF("Crop rectangle is negative.");
+        return CAMWIRE_FAILURE;
+    }
+    crop_left = left;
+    crop_top = top;
+    crop_width = width;
+    crop_height = height;
+    return CAMWIRE_SUCCESS;
+}
+
+int camwire::camwirepipeline::set_inv_gamma(const unsigned long max_val)
+{
+    if (max_val > UINT16_MAX)
+    {
+        DPRINTF("max_val exceeds 16-bit range.");
+        return CAMWIRE_FAILURE;
+    }
+    for (size_t i = 0; i < 256; ++i)
+        gamma_lut[i] = htons(static_cast<uint16_t>(max_val*gamma_inv[i] + 0.5));
+    gamma_maxval = max_val;
+    return CAMWIRE_SUCCESS;
+}
+
+int camwire::camwirepipeline::set_colour_coefficients(const double coef[9])
+{
+    if (!coef)
+    {
+        correct_colour = 0;
+        return CAMWIRE_SUCCESS;
+    }
+    for (int c = 0; c < 9; ++c)
+    {
+        /* Keeps the Q10 sums of 16-bit components within 32 bits: */
+        if (coef[c] < -8.0 || coef[c] > 8.0)
+        {
+            DPRINTF("Colour coefficient out of range.");
+            return CAMWIRE_FAILURE;
+        }
+        colour_coef[c] = static_cast<int32_t>(lround(coef[c]*1024.0));
+    }
+    correct_colour = 1;
+    return CAMWIRE_SUCCESS;
+}
+
+int camwire::camwirepipeline::run(const Camwire_bus_handle_ptr &c_handle, const void *src, void *dst, const size_t dst_stride)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        ERROR_IF_NULL(src);
+        ERROR_IF_NULL(dst);
+        User_handle internal_status = c_handle->userdata;
+        ERROR_IF_NULL(internal_status);
+
+        /* The crop is just a smaller image further into the frame: */
+        Camwire_geometry geometry = internal_status->geometry;
+        const uint8_t *origin = static_cast<const uint8_t *>(src);
+        if (crop_width > 0 && crop_height > 0)
+        {
+            const int align = (geometry.coding == CAMWIRE_PIXEL_YUV411 ? 4 :
+                               (geometry.coding == CAMWIRE_PIXEL_YUV422 ||
+                                (geometry.tiling != CAMWIRE_TILING_INVALID &&
+                                 geometry.tiling != CAMWIRE_TILING_UYVY &&
+                                 geometry.tiling != CAMWIRE_TILING_YUYV)) ? 2 : 1);
+            if (crop_left + crop_width > geometry.width || crop_top + crop_height > geometry.height ||
+                crop_left % align != 0 || crop_top % align != 0)
+            {
+                DPRINTF("Crop rectangle does not fit the frame or its colour layout.");
+                return CAMWIRE_FAILURE;
+            }
+            origin += crop_top*geometry.stride + static_cast<size_t>(crop_left)*geometry.depth/8;
+            geometry.width = crop_width;
+            geometry.height = crop_height;
+        }
+
+        if (gamma_maxval)
+        {
+            if (geometry.component_depth != 8 ||
+                (output != CAMWIRE_OUTPUT_GRAY16 && output != CAMWIRE_OUTPUT_RGB16))
+            {
+                DPRINTF("Inverse gamma needs 8-bit components and 16-bit output.");
+                return CAMWIRE_FAILURE;
+            }
+        }
+        if (correct_colour && (output == CAMWIRE_OUTPUT_GRAY8 || output == CAMWIRE_OUTPUT_GRAY16))
+        {
+            DPRINTF("Colour correction needs colour output.");
+            return CAMWIRE_FAILURE;
+        }
+        const Camwire_output first = gamma_maxval ?
+            (output == CAMWIRE_OUTPUT_RGB16 ? CAMWIRE_OUTPUT_RGB8 : CAMWIRE_OUTPUT_GRAY8) : output;
+        if (!kernels::convert_rows(0, geometry.stride, geometry.width, geometry.height, geometry.coding,
+                                   geometry.tiling, 0, 0, 0, first, method, 0, 0, 0))
+        {
+            DPRINTF("Cannot convert the current pixel coding to this output.");
+            return CAMWIRE_FAILURE;
+        }
+
+        const size_t row_bytes = static_cast<size_t>(geometry.width)*kernels::output_bytes(output);
+        const size_t out_stride = dst_stride ? dst_stride : row_bytes;
+        const int strip_rows = std::max<int>(2, (PIPELINE_STRIP_BYTES/std::max<size_t>(row_bytes, 1)) & ~1);
+        const int num_strips = (geometry.height + strip_rows - 1)/strip_rows;
+        uint8_t *out = static_cast<uint8_t *>(dst);
+        std::atomic<int> failed(0);
+        pool->parallel_for(num_strips, [&](const int strip, const int thread_index) {
+            int row_begin = strip*strip_rows;
+            int row_end = std::min(row_begin + strip_rows, geometry.height);
+            if (!run_strip(geometry, origin, out, out_stride, row_begin, row_end, scratch[thread_index]))
+                failed = 1;
+        });
+        if (failed)
+        {
+            DPRINTF("A pipeline stage failed.");
+            return CAMWIRE_FAILURE;
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to run pipeline");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwirepipeline::run_next_frame(const std::shared_ptr<camwire> &camera_manager, const Camwire_bus_handle_ptr &c_handle,
+                                             void *dst, const size_t dst_stride, int &buffer_lag)
+{
+    try
+    {
+        ERROR_IF_NULL(camera_manager);
+        void *buf_ptr;
+        ERROR_IF_CAMWIRE_FAIL(camera_manager->hold_next_frame(c_handle, &buf_ptr, buffer_lag));
+        uint64_t generation;
+        ERROR_IF_CAMWIRE_FAIL(camera_manager->get_frame_generation(c_handle, buf_ptr, generation));
+        int status = run(c_handle, buf_ptr, dst, dst_stride);
+        ERROR_IF_CAMWIRE_FAIL(camera_manager->release_frame(c_handle, buf_ptr, generation));
+        return status;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to run pipeline on next frame");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+/* Protected methods */
+
+int camwire::camwirepipeline::run_strip(const Camwire_geometry &geometry, const uint8_t *src, uint8_t *dst,
+                                        const size_t dst_stride, const int row_begin, const int row_end,
+                                        std::vector<uint8_t> &scratch)
+{
+    const int width = geometry.width;
+    if (gamma_maxval)
+    {
+        /* Convert to 8 bits into the scratch strip, then widen from there
+           into the output: */
+        const Camwire_output first = (output == CAMWIRE_OUTPUT_RGB16 ? CAMWIRE_OUTPUT_RGB8 : CAMWIRE_OUTPUT_GRAY8);
+        const int channels = kernels::output_bytes(first);
+        const size_t scratch_stride = static_cast<size_t>(width)*channels;
+        scratch.resize(scratch_stride*(row_end - row_begin));
+        /* The scratch strip starts at row row_begin: */
+        if (!kernels::convert_rows(src, geometry.stride, width, geometry.height, geometry.coding,
+                                   geometry.tiling, scratch.data(), scratch_stride, row_begin, first, method, 0,
+                                   row_begin, row_end))
+            return 0;
+        for (int y = row_begin; y < row_end; ++y)
+            kernels::lookup_8to16(scratch.data() + (y - row_begin)*scratch_stride,
+                                  reinterpret_cast<uint16_t *>(dst + y*dst_stride), scratch_stride, gamma_lut);
+    }
+    else if (!kernels::convert_rows(src, geometry.stride, width, geometry.height, geometry.coding,
+                                    geometry.tiling, dst, dst_stride, 0, output, method, linear_lut,
+                                    row_begin, row_end))
+        return 0;
+
+    /* The strip is still in cache from the stage before: */
+    if (correct_colour)
+        kernels::colour_correct_rows(dst, dst_stride, width, output == CAMWIRE_OUTPUT_RGB16 ? 2 : 1,
+                                     output == CAMWIRE_OUTPUT_BGR8, colour_coef, row_begin, row_end);
+    return 1;
+}
@@ -0,0 +1,355 @@
+/******************************************************************************
+
+    This file is part of Camwire, a generic camera interface.
+
+    Camwire is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of the
+    License, or (at your option) any later version.
+
+    Camwire is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Camwire; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+    USA
+
+
+    Title: Camera Reactor module
+
+    Description:
+    This Reactor module watches the capture file descriptors of many
+    cameras in level-triggered epoll sets.  An eventfd shared by all
+    sets wakes every waiting thread when stop() is called.
+
+Camwire++: Michele Adduci <info@micheleadduci.net>
+******************************************************************************/
+#include <camwirereactor.hpp>
+#include <cerrno>
+#include <thread>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/* Most events collected by one epoll_wait() call: */
+#define REACTOR_MAX_EVENTS  16
+
+camwire::camwirereactor::camwirereactor(): next_shard(0), next_serial(0), wakeup_fd(-1), stopping(0)
+{
+}
+
+camwire::camwirereactor::~camwirereactor()
+{
+    stop();
+    destroy();
+}
+
+int camwire::camwirereactor::create(const int num_shards)
+{
+    try
+    {
+        if (!shards.empty())
+        {
+            DPRINTF("Reactor already created.");
+            return CAMWIRE_FAILURE;
+        }
+        if (num_shards < 1)
+        {
+            DPRINTF("Need at least one shard.");
+            return CAMWIRE_FAILURE;
+        }
+
+        wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup_fd < 0)
+        {
+            DPRINTF("eventfd() failed.");
+            return CAMWIRE_FAILURE;
+        }
+        for (int s = 0; s < num_shards; ++s)
+        {
+            std::unique_ptr<Shard> shard(new Shard);
+            shard->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (shard->epoll_fd < 0)
+            {
+                DPRINTF("epoll_create1() failed.");
+                destroy();
+                return CAMWIRE_FAILURE;
+            }
+            /* A zero key marks the wakeup descriptor: */
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u64 = 0;
+            if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &event) != 0)
+            {
+                DPRINTF("epoll_ctl() failed to add the wakeup descriptor.");
+                close(shard->epoll_fd);
+                destroy();
+                return CAMWIRE_FAILURE;
+            }
+            shards.push_back(std::move(shard));
+        }
+        next_shard = 0;
+        stopping = 0;
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to create reactor");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwirereactor::destroy()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (size_t s = 0; s < shards.size(); ++s)
+        close(shards[s]->epoll_fd);
+    shards.clear();
+    if (wakeup_fd >= 0)
+    {
+        close(wakeup_fd);
+        wakeup_fd = -1;
+    }
+    return CAMWIRE_SUCCESS;
+}
+
+int camwire::camwirereactor::add_handle(const Camwire_bus_handle_ptr &c_handle)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (shards.empty())
+        {
+            DPRINTF("Reactor not created.");
+            return CAMWIRE_FAILURE;
+        }
+
+        int capture_fd = dc1394_capture_get_fileno(c_handle->camera.get());
+        if (capture_fd < 0)
+        {
+            DPRINTF("Camera has no capture file descriptor.");
+            return CAMWIRE_FAILURE;
+        }
+
+        Shard &shard = *shards[next_shard];
+        size_t slot = 0;
+        while (slot < shard.slots.size() && shard.slots[slot].handle)
+            ++slot;
+        if (slot == shard.slots.size())
+            shard.slots.push_back(Slot());
+        /* Serial numbers start at 1 so that no key is zero: */
+        if (++next_serial == 0)
+            ++next_serial;
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = (static_cast<uint64_t>(next_serial) << 32) | slot;
+        if (epoll_ctl(shard.epoll_fd, EPOLL_CTL_ADD, capture_fd, &event) != 0)
+        {
+            DPRINTF("epoll_ctl() failed to add the capture descriptor.");
+            return CAMWIRE_FAILURE;
+        }
+        shard.slots[slot].handle = c_handle;
+        shard.slots[slot].serial = next_serial;
+        next_shard = (next_shard + 1) % shards.size();
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to add handle to reactor");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwirereactor::add_bus(camwirebus &bus)
+{
+    try
+    {
+        std::vector<Camwire_bus_handle_ptr> handlers = bus.get_bus_handlers();
+        for (size_t h = 0; h < handlers.size(); ++h)
+            ERROR_IF_CAMWIRE_FAIL(add_handle(handlers[h]));
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to add bus to reactor");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwirereactor::remove_handle(const Camwire_bus_handle_ptr &c_handle)
+{
+    try
+    {
+        ERROR_IF_NULL(c_handle);
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (size_t s = 0; s < shards.size(); ++s)
+        {
+            std::vector<Slot> &slots = shards[s]->slots;
+            for (size_t slot = 0; slot < slots.size(); ++slot)
+            {
+                if (slots[slot].handle == c_handle)
+                {
+                    /* After a reconnect the old descriptor is already
+                       closed, which removed it from the set: */
+                    int capture_fd = dc1394_capture_get_fileno(c_handle->camera.get());
+                    struct epoll_event event;  /* Needed by old kernels.*/
+                    if (capture_fd >= 0 &&
+                        epoll_ctl(shards[s]->epoll_fd, EPOLL_CTL_DEL, capture_fd, &event) != 0 &&
+                        errno != ENOENT && errno != EBADF)
+                    {
+                        DPRINTF("epoll_ctl() failed to remove the capture descriptor.");
+                        return CAMWIRE_FAILURE;
+                    }
+                    /* A shard thread may already hold an event with
+                       this slot's key, which wait_shard() then finds
+                       empty or with a different serial number: */
+                    slots[slot].handle.reset();
+                    return CAMWIRE_SUCCESS;
+                }
+            }
+        }
+        DPRINTF("Handle is not registered with the reactor.");
+        return CAMWIRE_FAILURE;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to remove handle from reactor");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwirereactor::wait(std::vector<Camwire_bus_handle_ptr> &ready, const double timeout)
+{
+    try
+    {
+        ready.clear();
+        if (shards.empty())
+        {
+            DPRINTF("Reactor not created.");
+            return CAMWIRE_FAILURE;
+        }
+        if (shards.size() > 1)
+        {
+            DPRINTF("wait() needs a reactor with one shard; use run() for more.");
+            return CAMWIRE_FAILURE;
+        }
+        int timeout_ms = timeout < 0.0 ? -1 : static_cast<int>(timeout*1.0e3 + 0.999);
+        ERROR_IF_CAMWIRE_FAIL(wait_shard(*shards[0], ready, timeout_ms));
+        if (stopping)
+        {  /* wait() is one-shot, so rearm for the next call: */
+            uint64_t count;
+            if (read(wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                DPRINTF("Could not reset the wakeup descriptor.");
+            stopping = 0;
+            ready.clear();
+        }
+        return CAMWIRE_SUCCESS;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to wait for cameras");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwirereactor::run(const Camwire_frame_callback &callback)
+{
+    try
+    {
+        if (shards.empty())
+        {
+            DPRINTF("Reactor not created.");
+            return CAMWIRE_FAILURE;
+        }
+        if (!callback)
+        {
+            DPRINTF("No callback given.");
+            return CAMWIRE_FAILURE;
+        }
+
+        std::vector<std::thread> threads;
+        for (size_t s = 1; s < shards.size(); ++s)
+            threads.push_back(std::thread(&camwirereactor::run_shard, this, std::ref(*shards[s]), std::cref(callback)));
+        int status = run_shard(*shards[0], callback);
+        for (size_t t = 0; t < threads.size(); ++t)
+            threads[t].join();
+
+        uint64_t count;
+        if (read(wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            DPRINTF("Could not reset the wakeup descriptor.");
+        stopping = 0;
+        return status;
+    }
+    catch(std::runtime_error &re)
+    {
+        DPRINTF("Failed to run reactor");
+        return CAMWIRE_FAILURE;
+    }
+}
+
+int camwire::camwirereactor::stop()
+{
+    if (wakeup_fd < 0)
+        return CAMWIRE_SUCCESS;
+    stopping = 1;
+    uint64_t one = 1;
+    if (write(wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        DPRINTF("Could not signal the wakeup descriptor.");
+        return CAMWIRE_FAILURE;
+    }
+    return CAMWIRE_SUCCESS;
+}
+
+/* Private methods */
+
+int camwire::camwirereactor::wait_shard(Shard &shard, std::vector<Camwire_bus_handle_ptr> &ready, const int timeout_ms)
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    int num_events = epoll_wait(shard.epoll_fd, events, REACTOR_MAX_EVENTS, timeout_ms);
+    if (num_events < 0)
+    {
+        if (errno == EINTR)
+            return CAMWIRE_SUCCESS;
+        DPRINTF("epoll_wait() failed.");
+        return CAMWIRE_FAILURE;
+    }
+    /* The keys are only looked up under the lock, because
+       remove_handle() may have emptied a slot since epoll_wait()
+       returned: */
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (int e = 0; e < num_events; ++e)
+    {
+        uint64_t key = events[e].data.u64;
+        if (key == 0)
+            continue;  /* The wakeup descriptor.*/
+        size_t slot = static_cast<size_t>(key & 0xFFFFFFFFu);
+        uint32_t serial = static_cast<uint32_t>(key >> 32);
+        if (slot < shard.slots.size() && shard.slots[slot].handle &&
+            shard.slots[slot].serial == serial)
+            ready.push_back(shard.slots[slot].handle);
+    }
+    return CAMWIRE_SUCCESS;
+}
+
+int camwire::camwirereactor::run_shard(Shard &shard, const Camwire_frame_callback &callback)
+{
+    std::vector<Camwire_bus_handle_ptr> ready;
+    ready.reserve(REACTOR_MAX_EVENTS);
+    while (!stopping)
+    {
+        ready.clear();
+        if (wait_shard(shard, ready, -1) != CAMWIRE_SUCCESS)
+        {
+            stop();  /* Bring the other shards down too.*/
+            return CAMWIRE_FAILURE;
+        }
+        for (size_t r = 0; r < ready.size() && !stopping; ++r)
+            callback(ready[r]);
+    }
+    return CAMWIRE_SUCCESS;
+}
@@ -0,0 +1,80 @@
+/***********************************************************************
+    This file is in the public domain.
+
+    Description:
+
+    Times each implementation of the inverse gamma look-up, which widens
+    8-bit frames to 16 bits, that the host CPU supports against the
+    scalar one, on a 1280x960 RGB frame.  No camera is needed.
+
+    The implementations are internal to camwire_kernels.cpp, so it is
+    compiled into this program rather than linked.
+
+***********************************************************************/
+
+#include "camwire_kernels.cpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+    const size_t frame_components = 1280*960*3;
+    const int repeats = 50;
+
+    /* Best of repeats, in milliseconds per frame, as the least disturbed
+       by whatever else the host is doing: */
+    double time_lookup(Lookup_8to16_fn fn, const std::vector<uint8_t> &frame,
+                       std::vector<uint16_t> &out, const uint16_t *lut)
+    {
+        double best = 1e9;
+        for (int r = 0; r < repeats; ++r)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            fn(&frame[0], &out[0], frame.size(), lut);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+
+    /* Prints the time of fn and its speed-up over the scalar time,
+       which is fn's own time if scalar_ms is 0.  Returns the time: */
+    double report(const char *isa, Lookup_8to16_fn fn, const std::vector<uint8_t> &frame,
+                  const uint16_t *lut, const double scalar_ms)
+    {
+        std::vector<uint16_t> want(frame.size()), got(frame.size());
+        lookup_8to16_scalar(&frame[0], &want[0], frame.size(), lut);
+        const double ms = time_lookup(fn, frame, got, lut);
+        std::printf("lookup_8to16  %-9s %8.3f ms/frame  %5.2fx%s\n", isa, ms, (scalar_ms > 0 ? scalar_ms : ms)/ms,
+                    got == want ? "" : "  (WRONG OUTPUT)");
+        return ms;
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(1);
+    std::vector<uint8_t> frame(frame_components);
+    for (size_t i = 0; i < frame.size(); ++i)
+        frame[i] = static_cast<uint8_t>(rng());
+
+    /* An inverse gamma curve, as widened by camwire::copy_next_frame_as().
+       The timing does not depend on the values: */
+    uint16_t lut[256];
+    for (int v = 0; v < 256; ++v)
+        lut[v] = static_cast<uint16_t>(65535.0*std::pow(v/255.0, 1.0/0.45) + 0.5);
+
+    const double scalar_ms = report("scalar", lookup_8to16_scalar, frame, lut, 0);
+#ifdef CAMWIRE_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        report("avx2", lookup_8to16_avx2, frame, lut, scalar_ms);
+    if (__builtin_cpu_supports("avx512bw"))
+        report("avx512bw", lookup_8to16_avx512, frame, lut, scalar_ms);
+#endif
+    std::printf("dispatched: %s\n", camwire::kernels::lookup_8to16_isa());
+    return 0;
+}
@@ -0,0 +1,543 @@
+/***********************************************************************
+    This file is in the public domain.
+
+    Description:
+
+    Checks every SIMD pixel kernel the host CPU supports against the
+    scalar kernel it replaces, on random images of many widths, so that
+    the vector bodies, their row tails and odd widths are all covered,
+    and checks the demosaic, YUV and binning results against values
+    worked out by hand.  No camera is needed.  Returns 0 if all checks
+    pass.
+
+    The implementations are internal to camwire_kernels.cpp, so it is
+    compiled into this program rather than linked.
+
+***********************************************************************/
+
+#include "camwire_kernels.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+namespace
+{
+    std::mt19937 rng(20140304);
+
+    /* Random bytes, with plenty of the extreme values which clamping and
+       saturation get wrong: */
+    void fill_random(std::vector<uint8_t> &buf)
+    {
+        for (size_t i = 0; i < buf.size(); ++i)
+        {
+            switch (rng() % 8)
+            {
+                case 0:   buf[i] = 0;  break;
+                case 1:   buf[i] = 255;  break;
+                default:  buf[i] = static_cast<uint8_t>(rng());  break;
+            }
+        }
+    }
+
+    /* Image widths to try: every small one, so that each tail length
+       of each vector width comes up, and some larger ones: */
+    std::vector<int> test_widths()
+    {
+        std::vector<int> widths;
+        for (int w = 1; w <= 80; ++w)
+            widths.push_back(w);
+        const int large[] = {127, 129, 255, 257, 641, 1023};
+        for (size_t i = 0; i < sizeof(large)/sizeof(large[0]); ++i)
+            widths.push_back(large[i]);
+        return widths;
+    }
+
+    /* Row strides with a little slack, so that a kernel reading or
+       writing past its row shows up as a difference: */
+    size_t padded(const size_t row_bytes)
+    {
+        return row_bytes + rng() % 5;
+    }
+
+    int report(const char *kernel, const char *isa, const int runs, const int failures)
+    {
+        std::printf("%-16s %-9s %6d runs  %s\n", kernel, isa, runs, failures ? "FAILED" : "ok");
+        return failures;
+    }
+
+    int check_lookup_8to16(const char *isa, Lookup_8to16_fn fn)
+    {
+        const std::vector<int> widths = test_widths();
+        int runs = 0, failures = 0;
+        for (size_t w = 0; w < widths.size(); ++w)
+        {
+            const size_t n = 3*widths[w];
+            std::vector<uint8_t> inp(n);
+            fill_random(inp);
+            uint16_t lut[256];
+            for (int v = 0; v < 256; ++v)
+                lut[v] = static_cast<uint16_t>(rng());
+            std::vector<uint16_t> want(n + 1, 0x5a5a), got(n + 1, 0x5a5a);
+            lookup_8to16_scalar(&inp[0], &want[0], n, lut);
+            fn(&inp[0], &got[0], n, lut);
+            ++runs;
+            if (got != want)
+                ++failures;
+        }
+        return report("lookup_8to16", isa, runs, failures);
+    }
+
+    int check_be16_to_native()
+    {
+        const std::vector<int> widths = test_widths();
+        int runs = 0, failures = 0;
+        for (size_t w = 0; w < widths.size(); ++w)
+        {
+            for (int shift = -4; shift <= 4; shift += 2)
+            {
+                for (int is_signed = 0; is_signed < 2; ++is_signed)
+                {
+                    const size_t n = widths[w];
+                    std::vector<uint8_t> src(2*n);
+                    fill_random(src);
+                    std::vector<uint16_t> want(n + 1, 0x5a5a), got(n + 1, 0x5a5a);
+                    be16_to_native_scalar(&src[0], &want[0], n, shift, is_signed);
+                    be16_to_native_impl().fn(&src[0], &got[0], n, shift, is_signed);
+                    ++runs;
+                    if (got != want)
+                        ++failures;
+                }
+            }
+        }
+        return report("be16_to_native", be16_to_native_impl().isa, runs, failures);
+    }
+
+    int check_demosaic()
+    {
+        static const camwire::Camwire_tiling tilings[] = {
+            camwire::CAMWIRE_TILING_RGGB, camwire::CAMWIRE_TILING_GBRG,
+            camwire::CAMWIRE_TILING_GRBG, camwire::CAMWIRE_TILING_BGGR};
+        static const camwire::Camwire_demosaic methods[] = {
+            camwire::CAMWIRE_DEMOSAIC_NEAREST, camwire::CAMWIRE_DEMOSAIC_BILINEAR,
+            camwire::CAMWIRE_DEMOSAIC_EDGE_AWARE};
+        const Demosaic_band_fn scalar[2][2] = {{demosaic_band<1, 1>, demosaic_band<1, 2>},
+                                               {demosaic_band<2, 1>, demosaic_band<2, 2>}};
+        const Demosaic_impl &impl = demosaic_impl();
+        const std::vector<int> widths = test_widths();
+        int runs = 0, failures = 0;
+        for (size_t w = 0; w < widths.size(); ++w)
+        {
+            for (int t = 0; t < 4; ++t)
+            {
+                for (int m = 0; m < 3; ++m)
+                {
+                    for (int src_bytes = 1; src_bytes <= 2; ++src_bytes)
+                    {
+                        for (int out = 0; out < 3; ++out)
+                        {
+                            const int width = widths[w];
+                            const int height = 1 + rng() % 7;
+                            const int out_bytes = (out == 2) ? 2 : 1;
+                            Bayer_source source;
+                            const size_t src_stride = padded(width*src_bytes);
+                            std::vector<uint8_t> src(src_stride*height);
+                            fill_random(src);
+                            source.data = &src[0];
+                            source.stride = src_stride;
+                            source.width = width;
+                            source.height = height;
+                            int pattern[4];
+                            bayer_pattern(tilings[t], pattern);
+                            Bayer_channels ch;
+                            ch.green = 1;
+                            ch.red = (out == 1) ? 2 : 0;
+                            ch.blue = (out == 1) ? 0 : 2;
+
+                            /* The SIMD result is made in two bands, as
+                               camwire::demosaic() would: */
+                            const size_t dst_stride = padded(3*width*out_bytes);
+                            std::vector<uint8_t> want(dst_stride*height, 0x5a), got(dst_stride*height, 0x5a);
+                            const int split = height/2;
+                            scalar[src_bytes - 1][out_bytes - 1](source, pattern, &want[0], dst_stride, ch,
+                                                                 methods[m], 0, height);
+                            impl.band[src_bytes - 1][out_bytes - 1](source, pattern, &got[0], dst_stride, ch,
+                                                                    methods[m], 0, split);
+                            impl.band[src_bytes - 1][out_bytes - 1](source, pattern, &got[split*dst_stride],
+                                                                    dst_stride, ch, methods[m], split, height);
+                            ++runs;
+                            if (got != want)
+                                ++failures;
+                        }
+                    }
+                }
+            }
+        }
+        return report("demosaic", impl.isa, runs, failures);
+    }
+
+    int check_yuv_to_rgb()
+    {
+        static const camwire::Camwire_pixel codings[] = {
+            camwire::CAMWIRE_PIXEL_YUV411, camwire::CAMWIRE_PIXEL_YUV422,
+            camwire::CAMWIRE_PIXEL_YUV422, camwire::CAMWIRE_PIXEL_YUV444};
+        static const camwire::Camwire_tiling tilings[] = {
+            camwire::CAMWIRE_TILING_INVALID, camwire::CAMWIRE_TILING_UYVY,
+            camwire::CAMWIRE_TILING_YUYV, camwire::CAMWIRE_TILING_INVALID};
+        static const int coefs[2][4] = {{359, 88, 183, 454}, {403, 48, 120, 475}};
+        const std::vector<int> widths = test_widths();
+        int runs = 0, failures = 0;
+        for (size_t w = 0; w < widths.size(); ++w)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                for (int out = 0; out < 3; ++out)
+                {
+                    const Yuv_layout *layout = yuv_layout(codings[c], tilings[c]);
+                    const int width = widths[w]/layout->group_pixels*layout->group_pixels;
+                    if (width == 0)
+                        continue;
+                    Yuv_channels ch;
+                    ch.red = (out == 2) ? 2 : 0;
+                    ch.blue = (out == 1) ? 2 : 0;
+                    ch.pixel_bytes = out ? 3 : 1;
+                    std::vector<uint8_t> src(width/layout->group_pixels*layout->group_bytes);
+                    fill_random(src);
+                    std::vector<uint8_t> want(width*ch.pixel_bytes + 1, 0x5a), got(want);
+                    const int *coef = coefs[rng() % 2];
+                    yuv_row_scalar(&src[0], width, *layout, coef, &want[0], ch);
+                    yuv_row_impl().fn(&src[0], width, *layout, coef, &got[0], ch);
+                    ++runs;
+                    if (got != want)
+                        ++failures;
+                }
+            }
+        }
+        return report("yuv_to_rgb", yuv_row_impl().isa, runs, failures);
+    }
+
+    int check_colour_correct()
+    {
+        const std::vector<int> widths = test_widths();
+        int runs = 0, failures = 0;
+        for (size_t w = 0; w < widths.size(); ++w)
+        {
+            for (int component_bytes = 1; component_bytes <= 2; ++component_bytes)
+            {
+                /* Q10 gains up to about 2, with some crosstalk either
+                   way, so that results clamp at both ends: */
+                int32_t coef[9];
+                for (int i = 0; i < 9; ++i)
+                    coef[i] = static_cast<int32_t>(rng() % 2560) - ((i % 4 == 0) ? 256 : 1280);
+                std::vector<uint8_t> want(3*widths[w]*component_bytes + 1);
+                fill_random(want);
+                std::vector<uint8_t> got(want);
+                colour_correct_row_scalar_any(&want[0], widths[w], component_bytes, coef);
+                colour_row_impl().fn(&got[0], widths[w], component_bytes, coef);
+                ++runs;
+                if (got != want)
+                    ++failures;
+            }
+        }
+        return report("colour_correct", colour_row_impl().isa, runs, failures);
+    }
+
+    int check_reduce()
+    {
+        const Bin_row_impl &impl = bin_row_impl();
+        const std::vector<int> widths = test_widths();
+        int runs = 0, failures = 0;
+        for (size_t w = 0; w < widths.size(); ++w)
+        {
+            for (int bytes = 1; bytes <= 2; ++bytes)
+            {
+                for (int period = 1; period <= 2; ++period)
+                {
+                    for (int factor = 2; factor <= 4; factor += 2)
+                    {
+                        /* Output widths are whole Bayer tiles: */
+                        const int out_width = widths[w]/period*period;
+                        if (out_width == 0)
+                            continue;
+                        const size_t row_step = padded(out_width*factor*bytes);
+                        std::vector<uint8_t> src(row_step*factor);
+                        fill_random(src);
+                        std::vector<uint8_t> want(out_width*bytes + 1, 0x5a), got(want);
+                        (bytes == 2 ? bin16_row_scalar : bin8_row_scalar)(&src[0], row_step, out_width,
+                                                                         period, factor, &want[0]);
+                        (bytes == 2 ? impl.bin16 : impl.bin8)(&src[0], row_step, out_width,
+                                                              period, factor, &got[0]);
+                        ++runs;
+                        if (got != want)
+                            ++failures;
+                    }
+                }
+            }
+        }
+        return report("reduce", impl.isa, runs, failures);
+    }
+
+    /* The checks above only compare kernels with each other.  These
+       compare the dispatched kernels with values worked out by hand, so
+       that a mistake shared by all implementations shows up too. */
+
+    /* A Bayer image with one level per colour must demosaic to that
+       colour everywhere, edges included, whatever the method: */
+    int check_demosaic_flat()
+    {
+        static const camwire::Camwire_tiling tilings[] = {
+            camwire::CAMWIRE_TILING_RGGB, camwire::CAMWIRE_TILING_GBRG,
+            camwire::CAMWIRE_TILING_GRBG, camwire::CAMWIRE_TILING_BGGR};
+        static const camwire::Camwire_demosaic methods[] = {
+            camwire::CAMWIRE_DEMOSAIC_NEAREST, camwire::CAMWIRE_DEMOSAIC_BILINEAR,
+            camwire::CAMWIRE_DEMOSAIC_EDGE_AWARE};
+        static const int level[3] = {200, 100, 30};  /* Red, green, blue.*/
+        const int width = 37, height = 6;
+        int runs = 0, failures = 0;
+        for (int t = 0; t < 4; ++t)
+        {
+            int pattern[4];
+            bayer_pattern(tilings[t], pattern);
+            for (int src_bytes = 1; src_bytes <= 2; ++src_bytes)
+            {
+                /* 16-bit levels use the high byte too: */
+                const int scale = (src_bytes == 2) ? 257 : 1;
+                std::vector<uint8_t> src(width*src_bytes*height);
+                for (int y = 0; y < height; ++y)
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        const int value = scale*level[pattern[2*(y & 1) + (x & 1)]];
+                        uint8_t *sample = &src[(y*width + x)*src_bytes];
+                        if (src_bytes == 2)
+                        {
+                            sample[0] = static_cast<uint8_t>(value >> 8);
+                            sample[1] = static_cast<uint8_t>(value);
+                        }
+                        else
+                            sample[0] = static_cast<uint8_t>(value);
+                    }
+                }
+                const camwire::Camwire_output output =
+                    (src_bytes == 2) ? camwire::CAMWIRE_OUTPUT_RGB16 : camwire::CAMWIRE_OUTPUT_RGB8;
+                const size_t dst_stride = 3*width*src_bytes;
+                for (int m = 0; m < 3; ++m)
+                {
+                    std::vector<uint8_t> dst(dst_stride*height, 0x5a);
+                    ++runs;
+                    if (!camwire::kernels::demosaic_rows(&src[0], width*src_bytes, width, height, src_bytes,
+                                                         tilings[t], &dst[0], dst_stride, output,
+                                                         methods[m], 0, height))
+                    {
+                        ++failures;
+                        continue;
+                    }
+                    bool flat = true;
+                    for (int i = 0; i < 3*width*height; ++i)
+                    {
+                        const uint8_t *component = &dst[i*src_bytes];
+                        const int value = (src_bytes == 2) ? (component[0] << 8 | component[1]) : component[0];
+                        if (value != scale*level[i % 3])
+                            flat = false;
+                    }
+                    if (!flat)
+                        ++failures;
+                }
+            }
+        }
+        return report("demosaic flat", camwire::kernels::demosaic_isa(), runs, failures);
+    }
+
+    /* YUV444 pixels of known colours against RGB worked out in floating
+       point from the BT.601 and BT.709 matrices, rounded.  The kernels
+       use Q8 coefficients, so one step of difference is allowed: */
+    int check_yuv_to_rgb_values()
+    {
+        struct Known_colour
+        {
+            uint8_t yuv[3];
+            uint8_t rgb[2][3];  /* BT.601, BT.709.*/
+        };
+        static const Known_colour colours[] = {
+            {{128, 128, 128}, {{128, 128, 128}, {128, 128, 128}}},
+            {{ 16, 128, 128}, {{ 16,  16,  16}, { 16,  16,  16}}},
+            {{235, 128, 128}, {{235, 235, 235}, {235, 235, 235}}},
+            {{ 81,  90, 240}, {{238,  14,  14}, {255,  36,  10}}},
+            {{145,  54,  34}, {{ 13, 238,  14}, {  0, 203,   8}}},
+            {{ 41, 240, 110}, {{ 16,  15, 239}, { 13,  28, 249}}},
+            {{100, 200,  60}, {{  5, 124, 228}, {  0, 118, 234}}},
+            {{200,  30, 220}, {{255, 168,  26}, {255, 175,  18}}}};
+        static const camwire::Camwire_yuv_matrix matrices[2] = {camwire::CAMWIRE_YUV_BT601, camwire::CAMWIRE_YUV_BT709};
+        const int width = sizeof(colours)/sizeof(colours[0]);
+        /* YUV444 is stored U, Y, V: */
+        std::vector<uint8_t> src(3*width);
+        for (int x = 0; x < width; ++x)
+        {
+            src[3*x] = colours[x].yuv[1];
+            src[3*x + 1] = colours[x].yuv[0];
+            src[3*x + 2] = colours[x].yuv[2];
+        }
+        int runs = 0, failures = 0;
+        for (int m = 0; m < 2; ++m)
+        {
+            std::vector<uint8_t> dst(3*width);
+            ++runs;
+            if (!camwire::kernels::yuv_to_rgb_rows(&src[0], src.size(), width, camwire::CAMWIRE_PIXEL_YUV444,
+                                                   camwire::CAMWIRE_TILING_INVALID, &dst[0], dst.size(),
+                                                   camwire::CAMWIRE_OUTPUT_RGB8, matrices[m], 0, 1))
+            {
+                ++failures;
+                continue;
+            }
+            bool close = true;
+            for (int x = 0; x < width; ++x)
+                for (int c = 0; c < 3; ++c)
+                    if (std::abs(dst[3*x + c] - colours[x].rgb[m][c]) > 1)
+                        close = false;
+            if (!close)
+                ++failures;
+        }
+        return report("yuv_to_rgb value", camwire::kernels::yuv_to_rgb_isa(), runs, failures);
+    }
+
+    /* Each output pixel of a binned mono image must be the mean of its
+       block, rounded half up: */
+    int check_bin_mean()
+    {
+        const int out_width = 19, out_height = 2;
+        int runs = 0, failures = 0;
+        for (int bytes = 1; bytes <= 2; ++bytes)
+        {
+            for (int factor = 2; factor <= 4; factor += 2)
+            {
+                const int width = out_width*factor, height = out_height*factor;
+                std::vector<int> value(width*height);
+                std::vector<uint8_t> src(width*height*bytes);
+                for (int i = 0; i < width*height; ++i)
+                {
+                    value[i] = static_cast<int>(rng() % (bytes == 2 ? 65536 : 256));
+                    if (bytes == 2)
+                    {
+                        src[2*i] = static_cast<uint8_t>(value[i] >> 8);
+                        src[2*i + 1] = static_cast<uint8_t>(value[i]);
+                    }
+                    else
+                        src[i] = static_cast<uint8_t>(value[i]);
+                }
+                std::vector<uint8_t> dst(out_width*out_height*bytes, 0x5a);
+                ++runs;
+                if (!camwire::kernels::reduce_rows(&src[0], width*bytes, width, height,
+                                                   bytes == 2 ? camwire::CAMWIRE_PIXEL_MONO16 : camwire::CAMWIRE_PIXEL_MONO8,
+                                                   camwire::CAMWIRE_TILING_INVALID, factor, camwire::CAMWIRE_REDUCE_BIN,
+                                                   &dst[0], out_width*bytes, 0, out_height))
+                {
+                    ++failures;
+                    continue;
+                }
+                bool mean = true;
+                for (int oy = 0; oy < out_height; ++oy)
+                {
+                    for (int ox = 0; ox < out_width; ++ox)
+                    {
+                        int sum = 0;
+                        for (int dy = 0; dy < factor; ++dy)
+                            for (int dx = 0; dx < factor; ++dx)
+                                sum += value[(oy*factor + dy)*width + ox*factor + dx];
+                        const int want = (sum + factor*factor/2)/(factor*factor);
+                        const uint8_t *got = &dst[(oy*out_width + ox)*bytes];
+                        if ((bytes == 2 ? (got[0] << 8 | got[1]) : got[0]) != want)
+                            mean = false;
+                    }
+                }
+                if (!mean)
+                    ++failures;
+            }
+        }
+        return report("reduce mean", camwire::kernels::reduce_isa(), runs, failures);
+    }
+
+    void clear_accumulator(Stats_accumulator &acc)
+    {
+        std::memset(acc.histogram, 0, sizeof(acc.histogram));
+        acc.sum = 0;
+        acc.min = 65535;
+        acc.max = 0;
+        acc.samples = 0;
+    }
+
+    /* Which of the histogram tables a sample is counted in is up to the
+       kernel, so only their totals are compared: */
+    bool same_stats(const Stats_accumulator &a, const Stats_accumulator &b)
+    {
+        if (a.sum != b.sum || a.min != b.min || a.max != b.max || a.samples != b.samples)
+            return false;
+        for (int v = 0; v < 256; ++v)
+        {
+            uint32_t count_a = 0, count_b = 0;
+            for (int t = 0; t < HISTOGRAM_TABLES; ++t)
+            {
+                count_a += a.histogram[t][v];
+                count_b += b.histogram[t][v];
+            }
+            if (count_a != count_b)
+                return false;
+        }
+        return true;
+    }
+
+    int check_image_stats()
+    {
+        const std::vector<int> widths = test_widths();
+        int runs = 0, failures = 0;
+        for (size_t w = 0; w < widths.size(); ++w)
+        {
+            for (int channels = 1; channels <= 3; channels += 2)
+            {
+                const int num_samples = widths[w]*channels;
+                std::vector<uint8_t> src(2*num_samples);
+                fill_random(src);
+                Stats_accumulator want, got;
+                clear_accumulator(want);
+                clear_accumulator(got);
+                stats16_run_scalar(&src[0], num_samples, want);
+                stats16_run_impl().fn(&src[0], num_samples, got);
+                ++runs;
+                if (!same_stats(got, want))
+                    ++failures;
+            }
+        }
+        return report("image_stats", stats16_run_impl().isa, runs, failures);
+    }
+}
+
+int main()
+{
+    int failures = 0;
+
+    failures += check_lookup_8to16("scalar", lookup_8to16_scalar);
+#ifdef CAMWIRE_X86_DISPATCH
+    /* lookup_8to16() has a kernel for each instruction set, so all those
+       the CPU can run are tried, not only the one dispatched: */
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        failures += check_lookup_8to16("avx2", lookup_8to16_avx2);
+    if (__builtin_cpu_supports("avx512bw"))
+        failures += check_lookup_8to16("avx512bw", lookup_8to16_avx512);
+#endif
+    failures += check_be16_to_native();
+    failures += check_demosaic();
+    failures += check_yuv_to_rgb();
+    failures += check_colour_correct();
+    failures += check_reduce();
+    failures += check_demosaic_flat();
+    failures += check_yuv_to_rgb_values();
+    failures += check_bin_mean();
+    failures += check_image_stats();
+
+    if (failures)
+    {
+        std::printf("%d kernel checks FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}